@@ -0,0 +1,1862 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*
+ * Throughput benchmark of the lock-free structures.
+ *
+ * Every thread runs a random mix of reads, inserts and deletes of the keys
+ * 1..range for a fixed time and counts the operations.  On the sets a read
+ * is a lookup; on the queues an insert is a push of the key and a delete
+ * is a pop, and there are no reads.  At the end the structure is checked
+ * against the counts of successful inserts and deletes.
+ *
+ * With -l every operation is timed and recorded to a latency histogram of
+ * its thread and type (see hist.h); the histograms of the threads are
+ * merged at the end to report the percentiles of the whole run.
+ *
+ * With -e every thread counts cycles, instructions and cache and TLB
+ * misses in hardware (see perf.h), reported per operation.  The counters
+ * the system does not give us are reported as n/a.
+ *
+ * With -m the main thread samples the memory held back by the reclamation
+ * scheme (the nodes taken out of the structure and not yet reclaimed)
+ * during the run, and the peak is reported together with the peak RSS.
+ * -R runs the deque under each of its reclamation schemes, reference
+ * counting, hazard pointers and never freeing anything, every one in a
+ * process of its own so that their RSS does not mix.  Only the deque has
+ * such a baseline and reports its unreclaimed nodes; the list, the lru,
+ * the queue and the stack always reclaim with hazard pointers, -m shows
+ * only their RSS and -R cannot be combined with them.
+ *
+ * list-arena and deque-arena take their nodes from huge page backed NUMA
+ * arenas (see ll_pool_new_arena() in pool.h), to compare against list and
+ * deque.
+ *
+ * Some structures do not fit the mix and bring a driver of their own
+ * (see bench_mix()), which gives the threads different roles and ignores
+ * -r, or -i and -d where it says so:
+ *
+ *   list-iter	the odd threads iterate over the whole list and check
+ *		that the keys ascend, the even threads run the mix
+ *   list-snap	thread 0 snapshots the list to a temporary file and
+ *		loads it back, the other threads run the mix
+ *   list-clear	thread 0 clears the list over and over, the other threads
+ *		run the mix; list-bloom-clear with the Bloom filter
+ *   list-sorted every thread builds, checks and clears private lists
+ *		with ll_list_from_sorted(), the list itself is untouched
+ *   list-move	the even threads move the keys between two lists, the
+ *		odd threads read and walk them; run it with -p, every
+ *		prefilled key must end up in exactly one of the lists
+ *   mwcas	the threads move units between -k counters with
+ *		ll_mwcas() of up to eight words, or read one (-r); the
+ *		sum of the counters must stay what -p put in
+ *   wsdeque	thread 0 owns the deque and pushes (-i) and pops, the
+ *		other threads steal
+ *   deque-wait	the odd threads push bursts of values and pause, the
+ *		even threads take them with the blocking pops and sleep
+ *		in between; run it with at least two threads
+ *   spsc	the threads pair up on rings of -k slots, the even one
+ *		produces and the odd one consumes, in order
+ *   mpsc	thread 0 consumes, the others produce, in order per
+ *		producer and at most -k items of every producer at once
+ *   sched	every thread spawns trees of about -k tasks into one
+ *		scheduler with a worker per CPU and waits for them; a
+ *		task counts as an insert and must run exactly once
+ *
+ * lru never fills up, it is sized for twice the range.  lru-evict holds
+ * only half of the range, so the inserts keep evicting; its check at the
+ * end can only make sure that the cache has kept to its capacity.  The
+ * same goes for list-clear.
+ *
+ * Build with:
+ *
+ *	cc -std=gnu11 -O2 -DNDEBUG -o bench bench.c list.c lru.c mwcas.c \
+ *		tsigas-list.c queue.c stack.c mlq.c wsdeque.c scheduler.c \
+ *		spsc.c mpsc.c bloom.c cm.c ec.c elim.c fc.c hist.c hp.c \
+ *		perf.c pool.c tid.c -lpthread -lm
+ *
+ * Leave out -DNDEBUG to run with the assertions.  The deque must not be
+ * built with -DLL_DEQUE_TRACE, the benchmark refuses to run when it is.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fc.h"
+#include "hist.h"
+#include "ll_deque.h"
+#include "ll_list.h"
+#include "lru.h"
+#include "mlq.h"
+#include "mpsc.h"
+#include "mwcas.h"
+#include "perf.h"
+#include "queue.h"
+#include "scheduler.h"
+#include "spsc.h"
+#include "stack.h"
+#include "wsdeque.h"
+
+#define BENCH_MAX_THREADS 127 /* The thread ids of tid.h stop at 128, one is taken by the main thread */
+
+#define BENCH_DEFAULT_THREADS	4
+#define BENCH_DEFAULT_RANGE    1024
+#define BENCH_DEFAULT_INSERT   50
+#define BENCH_DEFAULT_DURATION 1.0
+
+#define BENCH_SAMPLE	    0.001  /* Seconds between the samples of -m */
+#define BENCH_CLEAR_PAUSE 0.0001 /* Seconds between the clears of list-clear */
+
+enum {
+	BENCH_READ,
+	BENCH_INSERT,
+	BENCH_DELETE,
+	BENCH_NOPS,
+};
+
+static const char *bench_op_names[BENCH_NOPS] = { "read", "insert", "delete" };
+
+typedef struct bench_thread bench_thread_t;
+
+typedef struct bench_ops {
+	const char *name;
+	void *(*new)(size_t range);
+	void (*destroy)(void *obj);
+	bool (*read)(void *obj, uintptr_t key); /* NULL when the structure has no lookup */
+	bool (*insert)(void *obj, uintptr_t key);
+	bool (*delete)(void *obj, uintptr_t key);
+	size_t (*count)(void *obj, size_t range); /* May empty the structure */
+	size_t (*unreclaimed)(void *obj);	  /* NULL when the structure does not tell */
+	size_t (*capacity)(size_t range);	  /* Set when the structure drops keys on its own */
+	void (*run)(void *obj, bench_thread_t *thread); /* Replaces the mix, see bench_mix() */
+} bench_ops_t;
+
+struct bench_thread {
+	alignas(128) pthread_t thread;
+	unsigned int index;
+	int cpu;
+	uint64_t seed;
+	uint64_t ops;
+	uint64_t reads;
+	uint64_t inserts; /* successful */
+	uint64_t deletes; /* successful */
+	double elapsed;
+	ll_hist_t *latency[BENCH_NOPS]; /* -l only */
+	uint64_t counters[LL_PERF_NCOUNTERS]; /* -e only */
+	bool counted[LL_PERF_NCOUNTERS];
+};
+
+typedef struct bench_config {
+	const bench_ops_t *ops;
+	unsigned int nthreads;
+	size_t range;
+	unsigned int read;
+	unsigned int insert;
+	unsigned int delete;
+	size_t prefill;
+	double duration;
+	bool pin;
+	bool latency;
+	bool counters;
+	bool memory;
+	bool compare;
+	bool csv;
+	bool header;
+} bench_config_t;
+
+static bench_config_t config = {
+	.nthreads = BENCH_DEFAULT_THREADS,
+	.range = BENCH_DEFAULT_RANGE,
+	.insert = BENCH_DEFAULT_INSERT,
+	.delete = 100 - BENCH_DEFAULT_INSERT,
+	.duration = BENCH_DEFAULT_DURATION,
+	.header = true,
+};
+
+static void *bench_obj;
+static pthread_barrier_t bench_start;
+static atomic_bool bench_stop = false;
+static size_t bench_unreclaimed_peak; /* -m only */
+static long bench_rss_peak;	      /* -m only, KiB */
+
+/* xorshift64* */
+static inline uint64_t
+bench_random(uint64_t *seed) {
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return (*seed * 2685821657736338717ULL);
+}
+
+static inline bool
+bench_running(void) {
+	return (!atomic_load_explicit(&bench_stop, memory_order_relaxed));
+}
+
+/* A driver found the structure broken, there is no point in going on */
+static void
+bench_broken(const char *what, uint64_t found, uint64_t expected) {
+	fprintf(stderr, "%s: %s, %" PRIu64 " found, %" PRIu64 " expected\n", config.ops->name, what, found, expected);
+	exit(EXIT_FAILURE);
+}
+
+static inline uint64_t
+bench_now_ns(void) {
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+static double
+bench_now(void) {
+	return ((double)bench_now_ns() / 1e9);
+}
+
+static void
+bench_sleep(double seconds) {
+	struct timespec ts = {
+		.tv_sec = (time_t)seconds,
+		.tv_nsec = (long)((seconds - (double)(time_t)seconds) * 1e9),
+	};
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+	}
+}
+
+static void
+bench_mix(void *obj, bench_thread_t *thread);
+
+/* Sets */
+
+static void *
+list_new(size_t range) {
+	(void)range;
+	return (ll_list_new());
+}
+
+static void *
+list_new_fc(size_t range) {
+	ll_list_t *list = ll_list_new();
+	(void)range;
+	ll_fc_set_mode(ll_list_fc(list), LL_FC_ADAPTIVE);
+	return (list);
+}
+
+static void *
+list_new_bloom(size_t range) {
+	return (ll_list_new_bloom(range));
+}
+
+static void *
+list_new_arena(size_t range) {
+	(void)range;
+	return (ll_list_new_arena());
+}
+
+static void
+list_destroy(void *obj) {
+	ll_list_destroy(obj);
+}
+
+static bool
+list_read(void *obj, uintptr_t key) {
+	return (ll_list_contains(obj, key));
+}
+
+static bool
+list_insert(void *obj, uintptr_t key) {
+	return (ll_list_insert(obj, key));
+}
+
+static bool
+list_delete(void *obj, uintptr_t key) {
+	return (ll_list_delete(obj, key));
+}
+
+static size_t
+list_count(void *obj, size_t range) {
+	size_t n = 0;
+	for (uintptr_t key = 1; key <= range; key++) {
+		n += ll_list_contains(obj, key);
+	}
+	return (n);
+}
+
+/* Iterate over the whole list, the keys must come strictly ascending and from the range */
+static size_t
+list_walk(ll_list_t *list) {
+	ll_list_iter_t iter;
+	ll_key_t key, last = 0;
+	size_t n = 0;
+
+	ll_list_iter_init(list, &iter);
+	while (ll_list_iter_next(&iter, &key)) {
+		if (key <= last || key > config.range) {
+			bench_broken("key out of order", key, last + 1);
+		}
+		last = key;
+		n++;
+	}
+	return (n);
+}
+
+/*
+ * list-iter: the odd threads iterate over the list, one pass counts as a read, while the even threads run the mix;
+ * every pass must return the keys in ascending order.
+ */
+static void
+list_iter_run(void *obj, bench_thread_t *thread) {
+	if (thread->index % 2 == 0) {
+		bench_mix(obj, thread);
+		return;
+	}
+
+	while (bench_running()) {
+		uint64_t t0 = config.latency ? bench_now_ns() : 0;
+		(void)list_walk(obj);
+		if (config.latency) {
+			ll_hist_record(thread->latency[BENCH_READ], bench_now_ns() - t0);
+		}
+		thread->reads++;
+		thread->ops++;
+	}
+}
+
+/*
+ * list-snap: thread 0 writes snapshots of the list to a temporary file and loads them back, one round trip counts as
+ * a read, while the other threads run the mix; the loaded list must hold as many keys as went to the file, in order.
+ */
+static void
+list_snap_run(void *obj, bench_thread_t *thread) {
+	if (thread->index != 0) {
+		bench_mix(obj, thread);
+		return;
+	}
+
+	FILE *file = tmpfile();
+	if (file == NULL) {
+		perror("tmpfile");
+		exit(EXIT_FAILURE);
+	}
+	int fd = fileno(file);
+
+	while (bench_running()) {
+		uint64_t t0 = config.latency ? bench_now_ns() : 0;
+		if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 || ll_list_snapshot(obj, fd) != 0) {
+			perror("snapshot");
+			exit(EXIT_FAILURE);
+		}
+		off_t size = lseek(fd, 0, SEEK_END);
+
+		ll_list_t *copy = ll_list_load(fd);
+		if (copy == NULL) {
+			perror("load");
+			exit(EXIT_FAILURE);
+		}
+		size_t n = list_walk(copy);
+		ll_list_destroy(copy);
+		if (config.latency) {
+			ll_hist_record(thread->latency[BENCH_READ], bench_now_ns() - t0);
+		}
+
+		/* The file is an 8 byte header followed by the keys, see list.c */
+		size_t written = ((size_t)size - 8) / sizeof(ll_key_t);
+		if (n != written) {
+			bench_broken("keys lost on load", n, written);
+		}
+		thread->reads++;
+		thread->ops++;
+	}
+	(void)fclose(file);
+}
+
+/*
+ * list-clear: thread 0 clears the list and pauses for the others to fill it up again, a clear counts as a read; the
+ * other threads run the mix.  The cleared keys are gone without a delete, so the check at the end can only bound what
+ * is left by the range.  list-bloom-clear does the same with the Bloom filter, which the clear has to empty as well.
+ */
+static size_t
+list_clear_capacity(size_t range) {
+	return (range);
+}
+
+static void
+list_clear_run(void *obj, bench_thread_t *thread) {
+	if (thread->index != 0) {
+		bench_mix(obj, thread);
+		return;
+	}
+
+	while (bench_running()) {
+		uint64_t t0 = config.latency ? bench_now_ns() : 0;
+		ll_list_clear(obj);
+		if (config.latency) {
+			ll_hist_record(thread->latency[BENCH_READ], bench_now_ns() - t0);
+		}
+		thread->reads++;
+		thread->ops++;
+		bench_sleep(BENCH_CLEAR_PAUSE);
+	}
+}
+
+/*
+ * list-sorted: every thread builds private lists of a random ascending part of the range with ll_list_from_sorted(),
+ * walks them, clears them and walks them again; one round counts as an operation, the shared list is left alone.
+ */
+static void
+list_sorted_run(void *obj, bench_thread_t *thread) {
+	ll_key_t *keys = malloc(config.range * sizeof(*keys));
+	uint64_t seed = thread->seed;
+	(void)obj;
+
+	assert(keys != NULL);
+	while (bench_running()) {
+		size_t n = 0;
+		for (ll_key_t key = 1; key <= config.range; key++) {
+			if (bench_random(&seed) & 1) {
+				keys[n++] = key;
+			}
+		}
+
+		ll_list_t *list = ll_list_from_sorted(keys, n);
+		ll_list_iter_t iter;
+		ll_key_t key;
+		size_t i = 0;
+
+		ll_list_iter_init(list, &iter);
+		while (ll_list_iter_next(&iter, &key)) {
+			if (i == n || key != keys[i]) {
+				bench_broken("wrong key", key, (i < n) ? keys[i] : 0);
+			}
+			i++;
+		}
+		if (i != n) {
+			bench_broken("keys missing", i, n);
+		}
+
+		ll_list_clear(list);
+		n = list_walk(list);
+		if (n != 0) {
+			bench_broken("keys left after the clear", n, 0);
+		}
+		ll_list_destroy(list);
+		thread->ops++;
+	}
+	free(keys);
+}
+
+/*
+ * list-move: the keys are moved back and forth between two lists with ll_list_move(), while the odd threads read
+ * both lists and walk the first one.  The prefill goes to the first list and nothing else is inserted or deleted, so
+ * every key must end up in exactly one of the two; a successful move counts as an insert and a delete.
+ */
+typedef struct bench_move {
+	ll_list_t *lists[2];
+} bench_move_t;
+
+static void *
+list_move_new(size_t range) {
+	bench_move_t *bm = malloc(sizeof(*bm));
+	assert(bm != NULL);
+	(void)range;
+
+	*bm = (bench_move_t){ .lists = { ll_list_new(), ll_list_new() } };
+	return (bm);
+}
+
+static void
+list_move_destroy(void *obj) {
+	bench_move_t *bm = obj;
+
+	ll_list_destroy(bm->lists[0]);
+	ll_list_destroy(bm->lists[1]);
+	free(bm);
+}
+
+static bool
+list_move_read(void *obj, uintptr_t key) {
+	bench_move_t *bm = obj;
+	return (ll_list_contains(bm->lists[0], key) || ll_list_contains(bm->lists[1], key));
+}
+
+static bool
+list_move_insert(void *obj, uintptr_t key) {
+	bench_move_t *bm = obj;
+	return (!ll_list_contains(bm->lists[1], key) && ll_list_insert(bm->lists[0], key));
+}
+
+/* Every key counts once for each list it is in */
+static size_t
+list_move_count(void *obj, size_t range) {
+	bench_move_t *bm = obj;
+	return (list_count(bm->lists[0], range) + list_count(bm->lists[1], range));
+}
+
+static void
+list_move_run(void *obj, bench_thread_t *thread) {
+	bench_move_t *bm = obj;
+	uint64_t seed = thread->seed;
+
+	while (bench_running()) {
+		uint64_t r = bench_random(&seed);
+		uintptr_t key = (uintptr_t)((r >> 16) % config.range) + 1;
+		unsigned int from = (unsigned int)(r & 1);
+
+		if (thread->index % 2 == 1) {
+			if (r & 0x100) {
+				(void)list_walk(bm->lists[from]);
+			}
+			thread->reads += ll_list_contains(bm->lists[from], key);
+		} else if (ll_list_move(bm->lists[from], bm->lists[!from], key)) {
+			thread->inserts++;
+			thread->deletes++;
+		}
+		thread->ops++;
+	}
+}
+
+/*
+ * The cache holds twice the range, so that nothing is evicted and the check at the end holds; the key is used as the
+ * value.  lru-evict holds half of the range and evicts all the time, the check only bounds what is left by the capacity.
+ */
+
+static void *
+lru_new(size_t range) {
+	return (ll_lru_new(2 * range));
+}
+
+static size_t
+lru_evict_capacity(size_t range) {
+	return ((range > 1) ? range / 2 : 1);
+}
+
+static void *
+lru_new_evict(size_t range) {
+	return (ll_lru_new(lru_evict_capacity(range)));
+}
+
+static void
+lru_destroy(void *obj) {
+	ll_lru_destroy(obj);
+}
+
+static bool
+lru_read(void *obj, uintptr_t key) {
+	return (ll_lru_get(obj, key) != NULL);
+}
+
+static bool
+lru_insert(void *obj, uintptr_t key) {
+	return (ll_lru_put(obj, key, (void *)key));
+}
+
+static bool
+lru_delete(void *obj, uintptr_t key) {
+	return (ll_lru_delete(obj, key));
+}
+
+static size_t
+lru_count(void *obj, size_t range) {
+	size_t n = 0;
+	for (uintptr_t key = 1; key <= range; key++) {
+		n += (ll_lru_get(obj, key) != NULL);
+	}
+	return (n);
+}
+
+/* Queues, the key is used as the value */
+
+static void *
+deque_new(size_t range) {
+	(void)range;
+	return (ll_deque_new(0));
+}
+
+static void *
+deque_new_hp(size_t range) {
+	(void)range;
+	return (ll_deque_new(LL_DEQUE_HP));
+}
+
+static void *
+deque_new_leak(size_t range) {
+	(void)range;
+	return (ll_deque_new(LL_DEQUE_LEAK));
+}
+
+static void *
+deque_new_arena(size_t range) {
+	(void)range;
+	return (ll_deque_new(LL_DEQUE_ARENA));
+}
+
+static void *
+deque_new_elim(size_t range) {
+	(void)range;
+	return (ll_deque_new(LL_DEQUE_HP | LL_DEQUE_ELIMINATION));
+}
+
+static void *
+deque_new_fc(size_t range) {
+	(void)range;
+	return (ll_deque_new(LL_DEQUE_HP | LL_DEQUE_COMBINING));
+}
+
+static void
+deque_destroy(void *obj) {
+	ll_deque_destroy(obj);
+}
+
+/* Both ends of the deque get exercised, the low bit of the key picks one */
+static bool
+deque_insert(void *obj, uintptr_t key) {
+	if (key & 1) {
+		ll_deque_push_left(obj, (void *)key);
+	} else {
+		ll_deque_push_right(obj, (void *)key);
+	}
+	return (true);
+}
+
+static bool
+deque_delete(void *obj, uintptr_t key) {
+	return (((key & 1) ? ll_deque_pop_left(obj) : ll_deque_pop_right(obj)) != NULL);
+}
+
+static size_t
+deque_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (ll_deque_pop_left(obj) != NULL) {
+		n++;
+	}
+	return (n);
+}
+
+static size_t
+deque_unreclaimed(void *obj) {
+	return (ll_deque_unreclaimed(obj));
+}
+
+#define BENCH_WAIT_NS	  1000000 /* The longest a consumer of deque-wait sleeps before it looks at bench_stop */
+#define BENCH_WAIT_BURST  16	  /* The most values a producer of deque-wait pushes at once */
+#define BENCH_WAIT_IDLE_S 10e-6	  /* And the pause after every burst */
+
+/*
+ * The odd threads produce bursts of values with a pause after each, the even threads consume them with the blocking
+ * pops, so that the consumers run the deque dry and go to sleep between the bursts.
+ */
+static void
+deque_wait_run(void *obj, bench_thread_t *thread) {
+	uint64_t seed = thread->seed;
+
+	while (bench_running()) {
+		uint64_t r = bench_random(&seed);
+		if (thread->index % 2 == 1) {
+			unsigned int burst = (unsigned int)(r % BENCH_WAIT_BURST) + 1;
+			for (unsigned int i = 0; i < burst; i++) {
+				thread->inserts += deque_insert(obj, (uintptr_t)((r >> 16) + i) % config.range + 1);
+			}
+			thread->ops += burst;
+			bench_sleep(BENCH_WAIT_IDLE_S);
+		} else {
+			void *value = (r & 1) ? ll_deque_pop_left_wait(obj, BENCH_WAIT_NS)
+					      : ll_deque_pop_right_wait(obj, BENCH_WAIT_NS);
+			thread->deletes += (value != NULL);
+			thread->ops++;
+		}
+	}
+}
+
+/* Work stealing: thread 0 owns the deque, pushes and pops at the bottom, the other threads steal from the top */
+
+static void *
+wsdeque_new(size_t range) {
+	(void)range;
+	return (ll_wsdeque_new(0));
+}
+
+static void
+wsdeque_destroy(void *obj) {
+	ll_wsdeque_destroy(obj);
+}
+
+static bool
+wsdeque_insert(void *obj, uintptr_t key) {
+	ll_wsdeque_push(obj, (void *)key);
+	return (true);
+}
+
+static bool
+wsdeque_delete(void *obj, uintptr_t key) {
+	(void)key;
+	return (ll_wsdeque_pop(obj) != NULL);
+}
+
+/* The prefill and the count run in the main thread, but never at the same time as the owner */
+static size_t
+wsdeque_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (ll_wsdeque_pop(obj) != NULL) {
+		n++;
+	}
+	return (n);
+}
+
+static void
+wsdeque_run(void *obj, bench_thread_t *thread) {
+	uint64_t seed = thread->seed;
+
+	while (bench_running()) {
+		if (thread->index == 0) {
+			uint64_t r = bench_random(&seed);
+			if ((unsigned int)(r & 0xffff) % 100 < config.insert) {
+				thread->inserts += wsdeque_insert(obj, (uintptr_t)((r >> 16) % config.range) + 1);
+			} else {
+				thread->deletes += wsdeque_delete(obj, 0);
+			}
+		} else {
+			thread->deletes += (ll_wsdeque_steal(obj) != NULL);
+		}
+		thread->ops++;
+	}
+}
+
+/*
+ * Scheduler: every thread spawns trees of tasks from the outside and waits for them; every task but the leaves spawns
+ * two more and syncs on them.  The trees have about 'range' tasks, and every task spawned must run exactly once.
+ */
+
+typedef struct bench_sched {
+	ll_sched_t *sched;
+	unsigned int depth;
+	ll_wait_group_t wg; /* The tasks of the prefill */
+	atomic_uint_fast64_t ran;
+} bench_sched_t;
+
+static void
+sched_task(void *arg) {
+	bench_sched_t *bs = bench_obj;
+	unsigned int depth = (unsigned int)(uintptr_t)arg;
+
+	(void)atomic_fetch_add_explicit(&bs->ran, 1, memory_order_relaxed);
+	if (depth > 0) {
+		ll_wait_group_t wg;
+		ll_wait_group_init(&wg);
+		ll_sched_spawn(bs->sched, &wg, sched_task, (void *)(uintptr_t)(depth - 1));
+		ll_sched_spawn(bs->sched, &wg, sched_task, (void *)(uintptr_t)(depth - 1));
+		ll_sched_sync(bs->sched, &wg);
+	}
+}
+
+static void *
+sched_new(size_t range) {
+	bench_sched_t *bs = calloc(1, sizeof(*bs));
+	assert(bs != NULL);
+
+	bs->sched = ll_sched_new(0);
+	while (((size_t)2 << (bs->depth + 1)) <= range + 1) {
+		bs->depth++;
+	}
+	ll_wait_group_init(&bs->wg);
+	atomic_init(&bs->ran, 0);
+
+	return (bs);
+}
+
+static void
+sched_destroy(void *obj) {
+	bench_sched_t *bs = obj;
+	ll_sched_destroy(bs->sched);
+	free(bs);
+}
+
+/* A single task, for the prefill */
+static bool
+sched_insert(void *obj, uintptr_t key) {
+	bench_sched_t *bs = obj;
+	(void)key;
+	ll_sched_spawn(bs->sched, &bs->wg, sched_task, (void *)(uintptr_t)0);
+	return (true);
+}
+
+static size_t
+sched_count(void *obj, size_t range) {
+	bench_sched_t *bs = obj;
+	(void)range;
+	ll_sched_sync(bs->sched, &bs->wg);
+	return (atomic_load(&bs->ran));
+}
+
+static void
+sched_run(void *obj, bench_thread_t *thread) {
+	bench_sched_t *bs = obj;
+	uint64_t tasks = ((uint64_t)2 << bs->depth) - 1;
+
+	while (bench_running()) {
+		ll_wait_group_t wg;
+		ll_wait_group_init(&wg);
+		ll_sched_spawn(bs->sched, &wg, sched_task, (void *)(uintptr_t)bs->depth);
+		ll_sched_sync(bs->sched, &wg);
+		thread->inserts += tasks;
+		thread->ops += tasks;
+	}
+}
+
+/*
+ * SPSC rings: the threads pair up, the even thread of a pair produces and the odd one consumes, every pair on a ring
+ * of its own.  Half of the items go through the slot API and half through the copies; the consumer checks that they
+ * come in the order they were produced.
+ */
+
+typedef struct bench_spsc_item {
+	uint64_t seq;
+	uint64_t pad;
+} bench_spsc_item_t;
+
+typedef struct bench_spsc_pair {
+	alignas(128) ll_spsc_t *ring;
+	uint64_t produced; /* Producer only */
+	alignas(128) uint64_t consumed; /* Consumer only */
+} bench_spsc_pair_t;
+
+static void *
+spsc_new(size_t range) {
+	unsigned int npairs = (config.nthreads + 1) / 2;
+	bench_spsc_pair_t *pairs = aligned_alloc(128, npairs * sizeof(pairs[0]));
+	assert(pairs != NULL);
+
+	for (unsigned int i = 0; i < npairs; i++) {
+		pairs[i] = (bench_spsc_pair_t){ .ring = ll_spsc_new(range, sizeof(bench_spsc_item_t)) };
+	}
+
+	return (pairs);
+}
+
+static void
+spsc_destroy(void *obj) {
+	bench_spsc_pair_t *pairs = obj;
+	for (unsigned int i = 0; i < (config.nthreads + 1) / 2; i++) {
+		ll_spsc_destroy(pairs[i].ring);
+	}
+	free(pairs);
+}
+
+static bool
+spsc_push(bench_spsc_pair_t *pair) {
+	bench_spsc_item_t item = { .seq = pair->produced };
+
+	if (!ll_spsc_push(pair->ring, &item)) {
+		return (false);
+	}
+	pair->produced++;
+	return (true);
+}
+
+static bool
+spsc_take(bench_spsc_pair_t *pair, bool copy) {
+	bench_spsc_item_t item;
+	bench_spsc_item_t *slot = &item;
+
+	if (copy) {
+		if (!ll_spsc_pop(pair->ring, &item)) {
+			return (false);
+		}
+	} else {
+		slot = ll_spsc_peek(pair->ring);
+		if (slot == NULL) {
+			return (false);
+		}
+	}
+	if (slot->seq != pair->consumed) {
+		bench_broken("item out of order", slot->seq, pair->consumed);
+	}
+	pair->consumed++;
+	if (!copy) {
+		ll_spsc_release(pair->ring);
+	}
+	return (true);
+}
+
+static size_t
+spsc_count(void *obj, size_t range) {
+	bench_spsc_pair_t *pairs = obj;
+	size_t n = 0;
+	(void)range;
+	for (unsigned int i = 0; i < (config.nthreads + 1) / 2; i++) {
+		while (spsc_take(&pairs[i], true)) {
+			n++;
+		}
+	}
+	return (n);
+}
+
+static void
+spsc_run(void *obj, bench_thread_t *thread) {
+	bench_spsc_pair_t *pair = &((bench_spsc_pair_t *)obj)[thread->index / 2];
+	bool copy = false;
+
+	while (bench_running()) {
+		copy = !copy;
+		if (thread->index % 2 == 1) {
+			thread->deletes += spsc_take(pair, copy);
+		} else if (copy) {
+			thread->inserts += spsc_push(pair);
+		} else {
+			bench_spsc_item_t *slot = ll_spsc_reserve(pair->ring);
+			if (slot != NULL) {
+				*slot = (bench_spsc_item_t){ .seq = pair->produced++ };
+				ll_spsc_commit(pair->ring);
+				thread->inserts++;
+			}
+		}
+		thread->ops++;
+	}
+}
+
+/*
+ * MPSC queue: thread 0 consumes, the other threads produce, half of the items through the reserve and commit steps;
+ * the consumer checks that the items of every producer come in the order they were produced.  The items are
+ * allocated by the producers and freed by the consumer; a producer holds off while 'range' of its items are queued.
+ */
+
+typedef struct bench_mpsc_item {
+	ll_mpsc_node_t node;
+	unsigned int producer;
+	uint64_t seq;
+} bench_mpsc_item_t;
+
+typedef struct bench_mpsc {
+	ll_mpsc_t *mpsc;
+	size_t range;
+	uint64_t *produced;		/* Per producer, the prefill is the last one */
+	atomic_uint_fast64_t *consumed; /* Written by the consumer only */
+} bench_mpsc_t;
+
+static void *
+mpsc_new(size_t range) {
+	bench_mpsc_t *bm = malloc(sizeof(*bm));
+	assert(bm != NULL);
+
+	*bm = (bench_mpsc_t){
+		.mpsc = ll_mpsc_new(),
+		.range = range,
+		.produced = calloc(config.nthreads + 1, sizeof(bm->produced[0])),
+		.consumed = calloc(config.nthreads + 1, sizeof(bm->consumed[0])),
+	};
+	assert(bm->produced != NULL && bm->consumed != NULL);
+	for (unsigned int i = 0; i <= config.nthreads; i++) {
+		atomic_init(&bm->consumed[i], 0);
+	}
+
+	return (bm);
+}
+
+static bool
+mpsc_produce(bench_mpsc_t *bm, unsigned int producer, bool reserve) {
+	uint64_t queued = bm->produced[producer] - atomic_load_explicit(&bm->consumed[producer], memory_order_relaxed);
+	if (producer < config.nthreads && queued >= bm->range) {
+		return (false);
+	}
+
+	bench_mpsc_item_t *item = malloc(sizeof(*item));
+	assert(item != NULL);
+
+	if (reserve) {
+		ll_mpsc_node_t *ticket = ll_mpsc_reserve(bm->mpsc, &item->node);
+		item->producer = producer;
+		item->seq = bm->produced[producer]++;
+		ll_mpsc_commit(bm->mpsc, ticket, &item->node);
+	} else {
+		item->producer = producer;
+		item->seq = bm->produced[producer]++;
+		ll_mpsc_push(bm->mpsc, &item->node);
+	}
+	return (true);
+}
+
+static bool
+mpsc_consume(bench_mpsc_t *bm) {
+	bench_mpsc_item_t *item = (bench_mpsc_item_t *)ll_mpsc_pop(bm->mpsc);
+
+	if (item == NULL) {
+		return (false);
+	}
+	uint64_t consumed = atomic_load_explicit(&bm->consumed[item->producer], memory_order_relaxed);
+	if (item->seq != consumed) {
+		bench_broken("item out of order", item->seq, consumed);
+	}
+	atomic_store_explicit(&bm->consumed[item->producer], consumed + 1, memory_order_relaxed);
+	free(item);
+	return (true);
+}
+
+static bool
+mpsc_insert(void *obj, uintptr_t key) {
+	(void)key;
+	return (mpsc_produce(obj, config.nthreads, false));
+}
+
+static size_t
+mpsc_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (mpsc_consume(obj)) {
+		n++;
+	}
+	return (n);
+}
+
+static void
+mpsc_destroy(void *obj) {
+	bench_mpsc_t *bm = obj;
+	(void)mpsc_count(bm, 0);
+	ll_mpsc_destroy(bm->mpsc);
+	free(bm->produced);
+	free(bm->consumed);
+	free(bm);
+}
+
+static void
+mpsc_run(void *obj, bench_thread_t *thread) {
+	bool reserve = false;
+
+	while (bench_running()) {
+		if (thread->index == 0) {
+			thread->deletes += mpsc_consume(obj);
+		} else {
+			reserve = !reserve;
+			thread->inserts += mpsc_produce(obj, thread->index, reserve);
+		}
+		thread->ops++;
+	}
+}
+
+/*
+ * mwcas: the words of an array of 'range' counters, the prefill adds one to a counter and ll_mwcas() moves a unit from
+ * one counter to each of up to LL_MWCAS_MAX_WORDS - 2 others, with one more counter only compared; a read is an
+ * ll_mwcas_read() of one counter.  The count at the end is the sum of the counters, which the moves must not change.
+ * The counters are shifted clear of the bits ll_mwcas() reserves.
+ */
+#define BENCH_MWCAS_UNIT ((uintptr_t)4)
+
+static void *
+mwcas_new(size_t range) {
+	atomic_uintptr_t *words = malloc(range * sizeof(*words));
+	assert(words != NULL);
+
+	for (size_t i = 0; i < range; i++) {
+		atomic_init(&words[i], 0);
+	}
+	return (words);
+}
+
+static void
+mwcas_destroy(void *obj) {
+	free(obj);
+	ll_mwcas_destroy();
+}
+
+static bool
+mwcas_read(void *obj, uintptr_t key) {
+	uintptr_t value = ll_mwcas_read((atomic_uintptr_t *)obj + key - 1);
+
+	if (value % BENCH_MWCAS_UNIT != 0) {
+		bench_broken("counter torn", value, value & ~(BENCH_MWCAS_UNIT - 1));
+	}
+	return (value != 0);
+}
+
+/* Only for the prefill */
+static bool
+mwcas_insert(void *obj, uintptr_t key) {
+	(void)atomic_fetch_add((atomic_uintptr_t *)obj + key - 1, BENCH_MWCAS_UNIT);
+	return (true);
+}
+
+static size_t
+mwcas_count(void *obj, size_t range) {
+	atomic_uintptr_t *words = obj;
+	size_t n = 0;
+
+	for (size_t i = 0; i < range; i++) {
+		n += ll_mwcas_read(&words[i]) / BENCH_MWCAS_UNIT;
+	}
+	return (n);
+}
+
+static void
+mwcas_run(void *obj, bench_thread_t *thread) {
+	atomic_uintptr_t *words = obj;
+	atomic_uintptr_t *addrs[LL_MWCAS_MAX_WORDS];
+	uintptr_t olds[LL_MWCAS_MAX_WORDS], news[LL_MWCAS_MAX_WORDS];
+	size_t max = (config.range < LL_MWCAS_MAX_WORDS) ? config.range : LL_MWCAS_MAX_WORDS;
+	uint64_t seed = thread->seed;
+
+	while (bench_running()) {
+		uint64_t r = bench_random(&seed);
+		uintptr_t key = (uintptr_t)((r >> 16) % config.range) + 1;
+
+		if ((unsigned int)(r & 0xffff) % 100 < config.read || max < 2) {
+			thread->reads += mwcas_read(words, key);
+			thread->ops++;
+			continue;
+		}
+
+		/*
+		 * Distinct counters, the first one gives a unit to each of the others but the last one, which is only
+		 * compared when there are more than two: the counters go up and down, ll_mwcas() takes one such word.
+		 */
+		size_t n = 2 + (size_t)(r & 0xff) % (max - 1);
+		for (size_t i = 0; i < n; i++) {
+			size_t j;
+			do {
+				addrs[i] = &words[bench_random(&seed) % config.range];
+				for (j = 0; j < i && addrs[j] != addrs[i]; j++) {
+				}
+			} while (j < i);
+			olds[i] = news[i] = ll_mwcas_read(addrs[i]);
+		}
+		size_t given = (n > 2) ? n - 2 : 1;
+		if (olds[0] >= given * BENCH_MWCAS_UNIT) {
+			news[0] -= given * BENCH_MWCAS_UNIT;
+			for (size_t i = 1; i <= given; i++) {
+				news[i] += BENCH_MWCAS_UNIT;
+			}
+			if (ll_mwcas(n, addrs, olds, news)) {
+				thread->inserts += given;
+				thread->deletes += given;
+			}
+		}
+		thread->ops++;
+	}
+}
+
+static void *
+queue_new(size_t range) {
+	(void)range;
+	return (ll_queue_new());
+}
+
+static void
+queue_destroy(void *obj) {
+	ll_queue_destroy(obj);
+}
+
+static bool
+queue_insert(void *obj, uintptr_t key) {
+	ll_queue_enqueue(obj, (void *)key);
+	return (true);
+}
+
+static bool
+queue_delete(void *obj, uintptr_t key) {
+	(void)key;
+	return (ll_queue_dequeue(obj) != NULL);
+}
+
+static size_t
+queue_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (ll_queue_dequeue(obj) != NULL) {
+		n++;
+	}
+	return (n);
+}
+
+static void *
+stack_new(size_t range) {
+	(void)range;
+	return (ll_stack_new(0));
+}
+
+static void *
+stack_new_elim(size_t range) {
+	(void)range;
+	return (ll_stack_new(LL_STACK_ELIMINATION));
+}
+
+static void
+stack_destroy(void *obj) {
+	ll_stack_destroy(obj);
+}
+
+static bool
+stack_insert(void *obj, uintptr_t key) {
+	ll_stack_push(obj, (void *)key);
+	return (true);
+}
+
+static bool
+stack_delete(void *obj, uintptr_t key) {
+	(void)key;
+	return (ll_stack_pop(obj) != NULL);
+}
+
+static size_t
+stack_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (ll_stack_pop(obj) != NULL) {
+		n++;
+	}
+	return (n);
+}
+
+static void *
+mlq_new(size_t range) {
+	(void)range;
+	return (ll_mlq_new(0));
+}
+
+static void
+mlq_destroy(void *obj) {
+	ll_mlq_destroy(obj);
+}
+
+static bool
+mlq_insert(void *obj, uintptr_t key) {
+	ll_mlq_push(obj, (void *)key);
+	return (true);
+}
+
+static bool
+mlq_delete(void *obj, uintptr_t key) {
+	(void)key;
+	return (ll_mlq_pop(obj) != NULL);
+}
+
+static size_t
+mlq_count(void *obj, size_t range) {
+	size_t n = 0;
+	(void)range;
+	while (ll_mlq_pop(obj) != NULL) {
+		n++;
+	}
+	return (n);
+}
+
+static const bench_ops_t bench_structures[] = {
+	{ .name = "list", .new = list_new, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count },
+	{ .name = "list-fc", .new = list_new_fc, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count },
+	{ .name = "list-bloom", .new = list_new_bloom, .destroy = list_destroy, .read = list_read,
+	  .insert = list_insert, .delete = list_delete, .count = list_count },
+	{ .name = "list-arena", .new = list_new_arena, .destroy = list_destroy, .read = list_read,
+	  .insert = list_insert, .delete = list_delete, .count = list_count },
+	{ .name = "list-iter", .new = list_new, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count, .run = list_iter_run },
+	{ .name = "list-snap", .new = list_new, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count, .run = list_snap_run },
+	{ .name = "list-clear", .new = list_new, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count, .capacity = list_clear_capacity, .run = list_clear_run },
+	{ .name = "list-bloom-clear", .new = list_new_bloom, .destroy = list_destroy, .read = list_read,
+	  .insert = list_insert, .delete = list_delete, .count = list_count, .capacity = list_clear_capacity,
+	  .run = list_clear_run },
+	{ .name = "list-sorted", .new = list_new, .destroy = list_destroy, .read = list_read, .insert = list_insert,
+	  .delete = list_delete, .count = list_count, .run = list_sorted_run },
+	{ .name = "list-move", .new = list_move_new, .destroy = list_move_destroy, .read = list_move_read,
+	  .insert = list_move_insert, .count = list_move_count, .run = list_move_run },
+	{ .name = "mwcas", .new = mwcas_new, .destroy = mwcas_destroy, .read = mwcas_read, .insert = mwcas_insert,
+	  .count = mwcas_count, .run = mwcas_run },
+	{ .name = "lru", .new = lru_new, .destroy = lru_destroy, .read = lru_read, .insert = lru_insert,
+	  .delete = lru_delete, .count = lru_count },
+	{ .name = "lru-evict", .new = lru_new_evict, .destroy = lru_destroy, .read = lru_read, .insert = lru_insert,
+	  .delete = lru_delete, .count = lru_count, .capacity = lru_evict_capacity },
+	{ .name = "deque", .new = deque_new, .destroy = deque_destroy, .insert = deque_insert, .delete = deque_delete,
+	  .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-hp", .new = deque_new_hp, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-leak", .new = deque_new_leak, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-arena", .new = deque_new_arena, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-elim", .new = deque_new_elim, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-fc", .new = deque_new_fc, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed },
+	{ .name = "deque-wait", .new = deque_new_hp, .destroy = deque_destroy, .insert = deque_insert,
+	  .delete = deque_delete, .count = deque_count, .unreclaimed = deque_unreclaimed, .run = deque_wait_run },
+	{ .name = "queue", .new = queue_new, .destroy = queue_destroy, .insert = queue_insert, .delete = queue_delete,
+	  .count = queue_count },
+	{ .name = "stack", .new = stack_new, .destroy = stack_destroy, .insert = stack_insert, .delete = stack_delete,
+	  .count = stack_count },
+	{ .name = "stack-elim", .new = stack_new_elim, .destroy = stack_destroy, .insert = stack_insert,
+	  .delete = stack_delete, .count = stack_count },
+	{ .name = "mlq", .new = mlq_new, .destroy = mlq_destroy, .insert = mlq_insert, .delete = mlq_delete,
+	  .count = mlq_count },
+	{ .name = "wsdeque", .new = wsdeque_new, .destroy = wsdeque_destroy, .insert = wsdeque_insert,
+	  .delete = wsdeque_delete, .count = wsdeque_count, .run = wsdeque_run },
+	{ .name = "sched", .new = sched_new, .destroy = sched_destroy, .insert = sched_insert, .count = sched_count,
+	  .run = sched_run },
+	{ .name = "spsc", .new = spsc_new, .destroy = spsc_destroy, .count = spsc_count, .run = spsc_run },
+	{ .name = "mpsc", .new = mpsc_new, .destroy = mpsc_destroy, .insert = mpsc_insert, .count = mpsc_count,
+	  .run = mpsc_run },
+};
+
+/* The reclamation schemes of the deque, for -R */
+static const char *bench_reclaim_structures[] = { "deque", "deque-hp", "deque-leak" };
+
+#define BENCH_NSTRUCTURES (sizeof(bench_structures) / sizeof(bench_structures[0]))
+
+static void
+bench_pin(int cpu) {
+	cpu_set_t set;
+
+	if (cpu < 0) {
+		return;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	/* Best effort, the thread runs unpinned when this fails */
+	(void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ * The random mix of reads, inserts and deletes that every thread runs until the end of the run.  The structures whose
+ * API does not fit the mix bring a driver of their own instead; it runs until bench_stop, counts its operations and
+ * its successful inserts and deletes the same way, so that the check at the end still holds.
+ */
+static void
+bench_mix(void *obj, bench_thread_t *thread) {
+	const bench_ops_t *ops = config.ops;
+	uint64_t seed = thread->seed;
+
+	while (bench_running()) {
+		uint64_t r = bench_random(&seed);
+		uintptr_t key = (uintptr_t)((r >> 16) % config.range) + 1;
+		unsigned int op = (unsigned int)(r & 0xffff) % 100;
+
+		unsigned int type = BENCH_DELETE;
+		if (op < config.read) {
+			type = BENCH_READ;
+		} else if (op < config.read + config.insert) {
+			type = BENCH_INSERT;
+		}
+
+		uint64_t t0 = config.latency ? bench_now_ns() : 0;
+
+		switch (type) {
+		case BENCH_READ: thread->reads += ops->read(obj, key); break;
+		case BENCH_INSERT: thread->inserts += ops->insert(obj, key); break;
+		case BENCH_DELETE: thread->deletes += ops->delete(obj, key); break;
+		}
+		if (config.latency) {
+			ll_hist_record(thread->latency[type], bench_now_ns() - t0);
+		}
+		thread->ops++;
+	}
+}
+
+static void *
+bench_thread(void *arg) {
+	bench_thread_t *thread = (bench_thread_t *)arg;
+	const bench_ops_t *ops = config.ops;
+	ll_perf_t *perf = NULL;
+
+	bench_pin(thread->cpu);
+	if (config.counters) {
+		perf = ll_perf_new();
+	}
+	(void)pthread_barrier_wait(&bench_start);
+
+	if (perf != NULL) {
+		ll_perf_start(perf);
+	}
+	double start = bench_now();
+	if (ops->run != NULL) {
+		ops->run(bench_obj, thread);
+	} else {
+		bench_mix(bench_obj, thread);
+	}
+	thread->elapsed = bench_now() - start;
+
+	if (perf != NULL) {
+		ll_perf_stop(perf);
+		for (unsigned int c = 0; c < LL_PERF_NCOUNTERS; c++) {
+			thread->counted[c] = ll_perf_read(perf, c, &thread->counters[c]);
+		}
+		ll_perf_destroy(perf);
+	}
+
+	return (NULL);
+}
+
+static size_t
+bench_prefill(void) {
+	uint64_t seed = 0x9e3779b97f4a7c15ULL;
+	size_t n = 0;
+
+	/* The keys of a set have to be distinct, so keep drawing until enough of them went in */
+	while (n < config.prefill) {
+		uintptr_t key = (uintptr_t)(bench_random(&seed) % config.range) + 1;
+		n += config.ops->insert(bench_obj, key);
+	}
+
+	return (n);
+}
+
+static void
+bench_csv_latency(ll_hist_t *const *latency) {
+	for (unsigned int op = 0; op < BENCH_NOPS; op++) {
+		printf(",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64, ll_hist_percentile(latency[op], 50),
+		       ll_hist_percentile(latency[op], 99), ll_hist_percentile(latency[op], 99.9), ll_hist_max(latency[op]));
+	}
+}
+
+static void
+bench_csv_counters(const uint64_t *counters, const bool *counted, uint64_t ops) {
+	for (unsigned int c = 0; c < LL_PERF_NCOUNTERS; c++) {
+		if (counted[c] && ops > 0) {
+			printf(",%.2f", (double)counters[c] / (double)ops);
+		} else {
+			printf(",");
+		}
+	}
+}
+
+static void
+bench_report(bench_thread_t *threads, double elapsed) {
+	const char *name = config.ops->name;
+	ll_hist_t *latency[BENCH_NOPS] = { NULL };
+	uint64_t counters[LL_PERF_NCOUNTERS] = { 0 };
+	bool counted[LL_PERF_NCOUNTERS] = { false };
+	uint64_t total = 0;
+
+	/* A counter is only summed up when every thread had it */
+	for (unsigned int c = 0; config.counters && c < LL_PERF_NCOUNTERS; c++) {
+		counted[c] = true;
+		for (unsigned int i = 0; i < config.nthreads; i++) {
+			counted[c] = counted[c] && threads[i].counted[c];
+			counters[c] += threads[i].counters[c];
+		}
+	}
+
+	if (config.latency) {
+		for (unsigned int op = 0; op < BENCH_NOPS; op++) {
+			latency[op] = ll_hist_new();
+			for (unsigned int i = 0; i < config.nthreads; i++) {
+				ll_hist_merge(latency[op], threads[i].latency[op]);
+			}
+		}
+	}
+
+	if (config.csv && config.header) {
+		printf("structure,threads,range,read,insert,delete,prefill,duration,thread,cpu,ops,ops_per_sec");
+		if (config.latency) {
+			for (unsigned int op = 0; op < BENCH_NOPS; op++) {
+				const char *n = bench_op_names[op];
+				printf(",%s_p50_ns,%s_p99_ns,%s_p999_ns,%s_max_ns", n, n, n, n);
+			}
+		}
+		for (unsigned int c = 0; config.counters && c < LL_PERF_NCOUNTERS; c++) {
+			printf(",%s_per_op", ll_perf_name(c));
+		}
+		if (config.memory) {
+			printf(",peak_unreclaimed_nodes,peak_rss_kb");
+		}
+		printf("\n");
+	}
+
+	for (unsigned int i = 0; i < config.nthreads; i++) {
+		bench_thread_t *thread = &threads[i];
+		double rate = (thread->elapsed > 0) ? (double)thread->ops / thread->elapsed : 0;
+		total += thread->ops;
+		if (config.csv) {
+			printf("%s,%u,%zu,%u,%u,%u,%zu,%.3f,%u,%d,%" PRIu64 ",%.0f", name, config.nthreads, config.range,
+			       config.read, config.insert, config.delete, config.prefill, thread->elapsed, i, thread->cpu,
+			       thread->ops, rate);
+			if (config.latency) {
+				bench_csv_latency(thread->latency);
+			}
+			if (config.counters) {
+				bench_csv_counters(thread->counters, thread->counted, thread->ops);
+			}
+			if (config.memory) {
+				printf(",,");
+			}
+			printf("\n");
+		} else {
+			printf("thread %3u: %12" PRIu64 " ops in %.3f s, %12.0f ops/s\n", i, thread->ops, thread->elapsed,
+			       rate);
+		}
+	}
+
+	double rate = (elapsed > 0) ? (double)total / elapsed : 0;
+	if (config.csv) {
+		printf("%s,%u,%zu,%u,%u,%u,%zu,%.3f,total,-1,%" PRIu64 ",%.0f", name, config.nthreads, config.range,
+		       config.read, config.insert, config.delete, config.prefill, elapsed, total, rate);
+		if (config.latency) {
+			bench_csv_latency(latency);
+		}
+		if (config.counters) {
+			bench_csv_counters(counters, counted, total);
+		}
+		if (config.memory) {
+			if (config.ops->unreclaimed != NULL) {
+				printf(",%zu,%ld", bench_unreclaimed_peak, bench_rss_peak);
+			} else {
+				printf(",,%ld", bench_rss_peak);
+			}
+		}
+		printf("\n");
+	} else {
+		printf("%s: %u threads, %12" PRIu64 " ops in %.3f s, %12.0f ops/s\n", name, config.nthreads, total,
+		       elapsed, rate);
+		for (unsigned int op = 0; config.latency && op < BENCH_NOPS; op++) {
+			if (ll_hist_count(latency[op]) == 0) {
+				continue;
+			}
+			printf("%-6s latency: %12" PRIu64 " ops, p50 %8" PRIu64 " ns, p99 %8" PRIu64 " ns, p99.9 %8" PRIu64
+			       " ns, max %10" PRIu64 " ns\n",
+			       bench_op_names[op], ll_hist_count(latency[op]), ll_hist_percentile(latency[op], 50),
+			       ll_hist_percentile(latency[op], 99), ll_hist_percentile(latency[op], 99.9),
+			       ll_hist_max(latency[op]));
+		}
+		if (config.counters) {
+			printf("per op:");
+			for (unsigned int c = 0; c < LL_PERF_NCOUNTERS; c++) {
+				if (counted[c] && total > 0) {
+					printf(" %s %.2f", ll_perf_name(c), (double)counters[c] / (double)total);
+				} else {
+					printf(" %s n/a", ll_perf_name(c));
+				}
+			}
+			printf("\n");
+		}
+		if (config.memory) {
+			if (config.ops->unreclaimed != NULL) {
+				printf("memory: peak %zu unreclaimed nodes, peak RSS %ld KiB\n", bench_unreclaimed_peak,
+				       bench_rss_peak);
+			} else {
+				printf("memory: peak RSS %ld KiB\n", bench_rss_peak);
+			}
+		}
+	}
+
+	if (config.counters && !counted[LL_PERF_CYCLES] && !counted[LL_PERF_INSTRUCTIONS]) {
+		fprintf(stderr, "warning: the hardware counters are not available, see perf_event_paranoid\n");
+	}
+
+	for (unsigned int op = 0; config.latency && op < BENCH_NOPS; op++) {
+		ll_hist_destroy(latency[op]);
+	}
+}
+
+static const bench_ops_t *
+bench_lookup(const char *structure) {
+	for (size_t i = 0; i < BENCH_NSTRUCTURES; i++) {
+		if (strcmp(bench_structures[i].name, structure) == 0) {
+			return (&bench_structures[i]);
+		}
+	}
+	return (NULL);
+}
+
+static void
+usage(const char *progname) {
+	fprintf(stderr,
+		"usage: %s [-c] [-e] [-H] [-l] [-m] [-P] [-R] [-s structure] [-t threads] [-k range] [-r read%%] [-i insert%%]\n"
+		"       [-d delete%%] [-p prefill] [-D seconds]\n"
+		"\n"
+		"  -s  structure to run (default list)\n"
+		"  -t  number of threads (default %u, at most %u)\n"
+		"  -k  keys are drawn from 1..range (default %zu)\n"
+		"  -r  percentage of reads (default 0)\n"
+		"  -i  percentage of inserts (default %u)\n"
+		"  -d  percentage of deletes (default: the rest)\n"
+		"  -p  number of keys inserted before the run (default 0)\n"
+		"  -D  duration of the run in seconds (default %.1f)\n"
+		"  -P  pin the threads to the CPUs, round robin\n"
+		"  -l  record the latency of every operation, report the percentiles\n"
+		"  -e  count cycles, instructions, cache and TLB misses per operation\n"
+		"  -m  report the peak of the unreclaimed nodes and of the RSS\n"
+		"  -R  compare the reclamation schemes of the deque, implies -m; the other\n"
+		"      structures have no leak baseline to compare against\n"
+		"  -c  emit CSV\n"
+		"  -H  leave out the CSV header, to append runs to one file\n"
+		"\n"
+		"structures:",
+		progname, BENCH_DEFAULT_THREADS, BENCH_MAX_THREADS, (size_t)BENCH_DEFAULT_RANGE, BENCH_DEFAULT_INSERT,
+		BENCH_DEFAULT_DURATION);
+	for (size_t i = 0; i < BENCH_NSTRUCTURES; i++) {
+		fprintf(stderr, " %s", bench_structures[i].name);
+	}
+	fprintf(stderr, "\n");
+	exit(EXIT_FAILURE);
+}
+
+static unsigned long
+parse_number(const char *progname, const char *arg, unsigned long max) {
+	char *end = NULL;
+	errno = 0;
+	unsigned long value = strtoul(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || value > max) {
+		fprintf(stderr, "%s: invalid number '%s'\n", progname, arg);
+		usage(progname);
+	}
+	return (value);
+}
+
+static int
+bench_run(const char *progname);
+
+int
+main(int argc, char **argv) {
+	const char *progname = argv[0];
+	const char *structure = "list";
+	bool delete_set = false;
+	bool structure_set = false;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "ceHlmPRs:t:k:r:i:d:p:D:h")) != -1) {
+		switch (ch) {
+		case 'c': config.csv = true; break;
+		case 'e': config.counters = true; break;
+		case 'H': config.header = false; break;
+		case 'l': config.latency = true; break;
+		case 'm': config.memory = true; break;
+		case 'P': config.pin = true; break;
+		case 'R':
+			config.compare = true;
+			config.memory = true;
+			break;
+		case 's':
+			structure = optarg;
+			structure_set = true;
+			break;
+		case 't': config.nthreads = parse_number(progname, optarg, BENCH_MAX_THREADS); break;
+		case 'k': config.range = parse_number(progname, optarg, UINTPTR_MAX - 2); break;
+		case 'r': config.read = parse_number(progname, optarg, 100); break;
+		case 'i': config.insert = parse_number(progname, optarg, 100); break;
+		case 'd':
+			config.delete = parse_number(progname, optarg, 100);
+			delete_set = true;
+			break;
+		case 'p': config.prefill = parse_number(progname, optarg, SIZE_MAX); break;
+		case 'D': {
+			char *end = NULL;
+			config.duration = strtod(optarg, &end);
+			if (end == optarg || *end != '\0' || !(config.duration > 0)) {
+				fprintf(stderr, "%s: invalid duration '%s'\n", progname, optarg);
+				usage(progname);
+			}
+			break;
+		}
+		default: usage(progname);
+		}
+	}
+	if (optind != argc) {
+		usage(progname);
+	}
+
+	if (ll_deque_tracing()) {
+		fprintf(stderr, "%s: the deque has been built with LL_DEQUE_TRACE, the results would measure the tracing\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+
+	if (config.compare) {
+		if (structure_set && strcmp(structure, bench_reclaim_structures[0]) != 0) {
+			fprintf(stderr, "%s: -R compares the deque only, '%s' has no leak baseline\n", progname,
+				structure);
+			usage(progname);
+		}
+		structure = bench_reclaim_structures[0];
+	}
+
+	config.ops = bench_lookup(structure);
+	if (config.ops == NULL) {
+		fprintf(stderr, "%s: unknown structure '%s'\n", progname, structure);
+		usage(progname);
+	}
+
+	if (!delete_set) {
+		config.delete = (config.read + config.insert <= 100) ? 100 - config.read - config.insert : 0;
+	}
+	if (config.read + config.insert + config.delete != 100) {
+		fprintf(stderr, "%s: the operation mix must add up to 100%%\n", progname);
+		usage(progname);
+	}
+	if (config.read > 0 && config.ops->read == NULL) {
+		fprintf(stderr, "%s: '%s' has no reads\n", progname, structure);
+		usage(progname);
+	}
+	if (config.nthreads == 0 || config.range == 0) {
+		usage(progname);
+	}
+	if (config.prefill > 0 && config.ops->insert == NULL) {
+		fprintf(stderr, "%s: '%s' cannot be prefilled\n", progname, structure);
+		usage(progname);
+	}
+	if (config.ops->read != NULL && config.prefill > config.range) {
+		fprintf(stderr, "%s: cannot prefill %zu distinct keys from a range of %zu\n", progname, config.prefill,
+			config.range);
+		usage(progname);
+	}
+
+	if (!config.compare) {
+		return (bench_run(progname));
+	}
+
+	/* Every scheme in a process of its own, one CSV header for all of them */
+	int status = EXIT_SUCCESS;
+	for (size_t i = 0; i < sizeof(bench_reclaim_structures) / sizeof(bench_reclaim_structures[0]); i++) {
+		(void)fflush(stdout);
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			exit(EXIT_FAILURE);
+		}
+		if (pid == 0) {
+			config.ops = bench_lookup(bench_reclaim_structures[i]);
+			config.header = config.header && i == 0;
+			int r = bench_run(progname);
+			(void)fflush(stdout);
+			_exit(r);
+		}
+		int wstatus;
+		if (waitpid(pid, &wstatus, 0) < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != EXIT_SUCCESS) {
+			status = EXIT_FAILURE;
+		}
+	}
+
+	return (status);
+}
+
+static int
+bench_run(const char *progname) {
+	/* The CPUs the process may run on, in order */
+	int cpus[CPU_SETSIZE];
+	int ncpus = 0;
+	cpu_set_t allowed;
+	if (config.pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &allowed)) {
+				cpus[ncpus++] = cpu;
+			}
+		}
+	}
+
+	bench_obj = config.ops->new(config.range);
+	size_t prefilled = bench_prefill();
+
+	bench_thread_t *threads = aligned_alloc(128, config.nthreads * sizeof(threads[0]));
+	if (threads == NULL) {
+		perror("aligned_alloc");
+		exit(EXIT_FAILURE);
+	}
+	(void)pthread_barrier_init(&bench_start, NULL, config.nthreads + 1);
+
+	for (unsigned int i = 0; i < config.nthreads; i++) {
+		threads[i] = (bench_thread_t){
+			.index = i,
+			.cpu = (ncpus > 0) ? cpus[i % ncpus] : -1,
+			.seed = 0x9e3779b97f4a7c15ULL * (i + 2),
+		};
+		for (unsigned int op = 0; config.latency && op < BENCH_NOPS; op++) {
+			threads[i].latency[op] = ll_hist_new();
+		}
+		int r = pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]);
+		if (r != 0) {
+			fprintf(stderr, "%s: pthread_create: %s\n", progname, strerror(r));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	(void)pthread_barrier_wait(&bench_start);
+	double start = bench_now();
+	double deadline = start + config.duration;
+	for (;;) {
+		if (config.memory && config.ops->unreclaimed != NULL) {
+			size_t unreclaimed = config.ops->unreclaimed(bench_obj);
+			if (unreclaimed > bench_unreclaimed_peak) {
+				bench_unreclaimed_peak = unreclaimed;
+			}
+		}
+		double left = deadline - bench_now();
+		if (left <= 0) {
+			break;
+		}
+		bench_sleep((config.memory && left > BENCH_SAMPLE) ? BENCH_SAMPLE : left);
+	}
+	atomic_store(&bench_stop, true);
+
+	for (unsigned int i = 0; i < config.nthreads; i++) {
+		(void)pthread_join(threads[i].thread, NULL);
+	}
+	double elapsed = bench_now() - start;
+
+	if (config.memory) {
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0) {
+			bench_rss_peak = usage.ru_maxrss;
+		}
+	}
+
+	bench_report(threads, elapsed);
+
+	/* Whatever went in and did not come out must still be there */
+	uint64_t expected = prefilled;
+	for (unsigned int i = 0; i < config.nthreads; i++) {
+		expected += threads[i].inserts - threads[i].deletes;
+	}
+	size_t count = config.ops->count(bench_obj, config.range);
+	config.ops->destroy(bench_obj);
+	(void)pthread_barrier_destroy(&bench_start);
+	for (unsigned int i = 0; i < config.nthreads; i++) {
+		for (unsigned int op = 0; config.latency && op < BENCH_NOPS; op++) {
+			ll_hist_destroy(threads[i].latency[op]);
+		}
+	}
+	free(threads);
+
+	if (config.ops->capacity != NULL) {
+		/* The evicted or cleared keys are gone without a delete, but the structure must have kept to its capacity */
+		size_t capacity = config.ops->capacity(config.range);
+		if (count > expected || count > capacity) {
+			fprintf(stderr,
+				"%s: consistency check failed, %zu elements left, at most %" PRIu64
+				" expected and the capacity is %zu\n",
+				progname, count, expected, capacity);
+			return (EXIT_FAILURE);
+		}
+		if (!config.csv) {
+			printf("dropped: %" PRIu64 " elements, %zu left of the capacity %zu\n", expected - count, count,
+			       capacity);
+		}
+	} else if (count != expected) {
+		fprintf(stderr, "%s: consistency check failed, %zu elements left, %" PRIu64 " expected\n", progname,
+			count, expected);
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
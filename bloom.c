@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+
+#define BLOOM_DEFAULT_CAPACITY 1024
+#define BLOOM_COUNTERS	       16 /* counters per block, one cache line */
+#define BLOOM_HASHES	       4  /* This is named 'k' in the literature */
+#define BLOOM_BITS_PER_KEY     8  /* counters per key, named 'm/n' */
+
+typedef struct bloom_block {
+	alignas(64) atomic_uint_least32_t counter[BLOOM_COUNTERS];
+} bloom_block_t;
+
+struct ll_bloom {
+	size_t mask;
+	bloom_block_t *blocks;
+};
+
+/*
+ * The keys are mostly pointers, so the low bits carry almost no entropy;
+ * use the splitmix64 finalizer to spread them over the whole word.
+ */
+static inline uint64_t
+bloom_hash(uintptr_t key) {
+	uint64_t h = (uint64_t)key;
+	h = (h ^ (h >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	h = (h ^ (h >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return (h ^ (h >> 31));
+}
+
+static inline bloom_block_t *
+bloom_block(ll_bloom_t *bloom, uint64_t h) {
+	return (&bloom->blocks[(h >> 32) & bloom->mask]);
+}
+
+#define bloom_slot(h, i) (((h) >> ((i) * 4)) & (BLOOM_COUNTERS - 1))
+
+ll_bloom_t *
+ll_bloom_new(size_t capacity) {
+	ll_bloom_t *bloom = calloc(1, sizeof(*bloom));
+	size_t nblocks = 1;
+
+	assert(bloom != NULL);
+
+	if (capacity == 0) {
+		capacity = BLOOM_DEFAULT_CAPACITY;
+	}
+
+	while (nblocks * BLOOM_COUNTERS < capacity * BLOOM_BITS_PER_KEY) {
+		nblocks <<= 1;
+	}
+
+	bloom->mask = nblocks - 1;
+	bloom->blocks = aligned_alloc(64, nblocks * sizeof(bloom->blocks[0]));
+	assert(bloom->blocks != NULL);
+
+	for (size_t i = 0; i < nblocks; i++) {
+		for (size_t j = 0; j < BLOOM_COUNTERS; j++) {
+			atomic_init(&bloom->blocks[i].counter[j], 0);
+		}
+	}
+
+	return (bloom);
+}
+
+void
+ll_bloom_destroy(ll_bloom_t *bloom) {
+	assert(bloom != NULL);
+	free(bloom->blocks);
+	free(bloom);
+}
+
+void
+ll_bloom_add(ll_bloom_t *bloom, uintptr_t key) {
+	uint64_t h = bloom_hash(key);
+	bloom_block_t *block = bloom_block(bloom, h);
+
+	for (size_t i = 0; i < BLOOM_HASHES; i++) {
+		(void)atomic_fetch_add(&block->counter[bloom_slot(h, i)], 1);
+	}
+}
+
+void
+ll_bloom_remove(ll_bloom_t *bloom, uintptr_t key) {
+	uint64_t h = bloom_hash(key);
+	bloom_block_t *block = bloom_block(bloom, h);
+
+	for (size_t i = 0; i < BLOOM_HASHES; i++) {
+		uint_least32_t old = atomic_fetch_sub(&block->counter[bloom_slot(h, i)], 1);
+		assert(old > 0);
+		(void)old;
+	}
+}
+
+bool
+ll_bloom_test(ll_bloom_t *bloom, uintptr_t key) {
+	uint64_t h = bloom_hash(key);
+	bloom_block_t *block = bloom_block(bloom, h);
+
+	for (size_t i = 0; i < BLOOM_HASHES; i++) {
+		if (atomic_load(&block->counter[bloom_slot(h, i)]) == 0) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
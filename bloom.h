@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*%
+ * Concurrent counting Bloom filter.
+ *
+ * The filter is blocked: all counters for a given key live in a single
+ * cache line, so a lookup costs one cache miss regardless of the number
+ * of hash functions.  Counters are updated with atomic increments and
+ * decrements, which makes it possible to remove keys again.
+ *
+ * The filter never reports false negatives as long as every
+ * ll_bloom_remove() is paired with an earlier ll_bloom_add() of the
+ * same key.
+ */
+
+typedef struct ll_bloom ll_bloom_t;
+
+ll_bloom_t *
+ll_bloom_new(size_t capacity);
+/*%<
+ * Create a new filter sized for roughly 'capacity' keys (or a reasonable
+ * default value if 'capacity' is 0).
+ */
+
+void
+ll_bloom_destroy(ll_bloom_t *bloom);
+/*%<
+ * Destroy the filter.
+ */
+
+void
+ll_bloom_add(ll_bloom_t *bloom, uintptr_t key);
+/*%<
+ * Add 'key' to the filter.
+ *
+ * Progress condition: wait-free bounded (by the number of hash functions)
+ */
+
+void
+ll_bloom_remove(ll_bloom_t *bloom, uintptr_t key);
+/*%<
+ * Remove 'key' from the filter.  The key must have been added before.
+ *
+ * Progress condition: wait-free bounded (by the number of hash functions)
+ */
+
+bool
+ll_bloom_test(ll_bloom_t *bloom, uintptr_t key);
+/*%<
+ * Return false if 'key' is definitely not in the filter, true if it
+ * might be.
+ *
+ * Progress condition: wait-free bounded (by the number of hash functions)
+ */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "cm.h"
+#include "tid.h"
+
+#define CM_MIN_SPINS 16
+#define CM_MAX_SPINS 4096
+
+static thread_local uint32_t seed_v = 0;
+
+/* Failure counters are written by their owner only, keep them apart */
+typedef struct cm_counter {
+	alignas(128) atomic_uint_fast64_t failures;
+} cm_counter_t;
+
+struct ll_cm {
+	atomic_int strategy;
+	unsigned int min_spins;
+	unsigned int max_spins;
+	cm_counter_t counters[LL_TID_MAX];
+};
+
+/* xorshift32, good enough to desynchronize the threads */
+static inline uint32_t
+cm_random(void) {
+	if (seed_v == 0) {
+		seed_v = 2463534242U + (uint32_t)ll_tid();
+	}
+	seed_v ^= seed_v << 13;
+	seed_v ^= seed_v >> 17;
+	seed_v ^= seed_v << 5;
+	return (seed_v);
+}
+
+static inline void
+cm_spin(unsigned int spins) {
+	for (unsigned int i = 0; i < spins; i++) {
+		ll_cm_pause();
+	}
+}
+
+ll_cm_t *
+ll_cm_new(ll_cm_strategy_t strategy, unsigned int min_spins, unsigned int max_spins) {
+	ll_cm_t *cm = aligned_alloc(128, sizeof(*cm));
+	assert(cm != NULL);
+
+	if (min_spins == 0) {
+		min_spins = CM_MIN_SPINS;
+	}
+	if (max_spins == 0) {
+		max_spins = CM_MAX_SPINS;
+	}
+	assert(min_spins <= max_spins);
+
+	cm->min_spins = min_spins;
+	cm->max_spins = max_spins;
+	atomic_init(&cm->strategy, strategy);
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		atomic_init(&cm->counters[i].failures, 0);
+	}
+
+	return (cm);
+}
+
+void
+ll_cm_destroy(ll_cm_t *cm) {
+	assert(cm != NULL);
+	free(cm);
+}
+
+void
+ll_cm_set_strategy(ll_cm_t *cm, ll_cm_strategy_t strategy) {
+	atomic_store_explicit(&cm->strategy, strategy, memory_order_relaxed);
+}
+
+void
+ll_cm_backoff(ll_cm_t *cm, unsigned int *attempt) {
+	atomic_uint_fast64_t *failures = &cm->counters[ll_tid()].failures;
+	unsigned int n = (*attempt)++;
+	unsigned int spins;
+
+	atomic_store_explicit(failures, atomic_load_explicit(failures, memory_order_relaxed) + 1,
+			      memory_order_relaxed);
+
+	switch (atomic_load_explicit(&cm->strategy, memory_order_relaxed)) {
+	case LL_CM_NONE:
+		break;
+	case LL_CM_SPIN:
+		cm_spin(cm->min_spins);
+		break;
+	case LL_CM_BACKOFF:
+		spins = cm->min_spins;
+		while (n-- > 0 && spins < cm->max_spins) {
+			spins <<= 1;
+		}
+		if (spins > cm->max_spins) {
+			spins = cm->max_spins;
+		}
+		/* Randomize the delay within [spins/2, spins] */
+		cm_spin(spins / 2 + cm_random() % (spins / 2 + 1));
+		break;
+	case LL_CM_YIELD:
+		(void)sched_yield();
+		break;
+	default:
+		assert(0);
+	}
+}
+
+uint64_t
+ll_cm_failures(ll_cm_t *cm) {
+	uint64_t total = 0;
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		total += atomic_load_explicit(&cm->counters[i].failures, memory_order_relaxed);
+	}
+	return (total);
+}
+
+void
+ll_cm_reset(ll_cm_t *cm) {
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		atomic_store_explicit(&cm->counters[i].failures, 0, memory_order_relaxed);
+	}
+}
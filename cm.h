@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*%
+ * Contention manager.
+ *
+ * Lock-free algorithms retry their CAS when another thread got there
+ * first; the contention manager decides what happens between two
+ * attempts.  Every data structure owns its own contention manager, so
+ * the strategy can be tuned per structure, and the manager counts the
+ * failed attempts per thread so the tuning can be measured.
+ */
+
+typedef enum ll_cm_strategy {
+	LL_CM_NONE,    /* retry immediately */
+	LL_CM_SPIN,    /* spin for a fixed number of pause instructions */
+	LL_CM_BACKOFF, /* spin for an exponentially growing, randomized time */
+	LL_CM_YIELD,   /* give up the CPU with sched_yield() */
+} ll_cm_strategy_t;
+
+typedef struct ll_cm ll_cm_t;
+
+static inline void
+ll_cm_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+/*%<
+ * Tell the CPU we are spinning.
+ */
+
+ll_cm_t *
+ll_cm_new(ll_cm_strategy_t strategy, unsigned int min_spins, unsigned int max_spins);
+/*%<
+ * Create a new contention manager using 'strategy'.  LL_CM_SPIN spins
+ * 'min_spins' times on every failure, LL_CM_BACKOFF starts with
+ * 'min_spins' and doubles the delay up to 'max_spins'.  Zero selects a
+ * reasonable default value for either of them.
+ */
+
+void
+ll_cm_destroy(ll_cm_t *cm);
+/*%<
+ * Destroy the contention manager.
+ */
+
+void
+ll_cm_set_strategy(ll_cm_t *cm, ll_cm_strategy_t strategy);
+/*%<
+ * Switch the contention manager to a different strategy.  This is safe
+ * to call while other threads are using the contention manager.
+ */
+
+void
+ll_cm_backoff(ll_cm_t *cm, unsigned int *attempt);
+/*%<
+ * Record a failed attempt and wait according to the strategy.  'attempt'
+ * points to a per-operation counter that must be initialized to 0 when
+ * the operation starts; it is incremented on every call.
+ *
+ * Progress condition: wait-free bounded (by 'max_spins'), unless the
+ * strategy is LL_CM_YIELD.
+ */
+
+uint64_t
+ll_cm_failures(ll_cm_t *cm);
+/*%<
+ * Return the number of failed attempts recorded by all threads so far.
+ */
+
+void
+ll_cm_reset(ll_cm_t *cm);
+/*%<
+ * Reset the failure counters to zero.
+ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ec.h"
+
+static inline long
+futex(atomic_uint *uaddr, int op, unsigned int val, const struct timespec *timeout) {
+	return (syscall(SYS_futex, (unsigned int *)uaddr, op, val, timeout, NULL, 0));
+}
+
+void
+ll_ec_init(ll_ec_t *ec) {
+	atomic_init(&ec->seq, 0);
+	atomic_init(&ec->waiters, 0);
+}
+
+/*
+ * The waiter increments 'waiters' before it checks the condition, the
+ * notifier makes the condition true before it checks 'waiters'; with
+ * both sides sequentially consistent at least one of them sees the
+ * other.
+ */
+unsigned int
+ll_ec_prepare(ll_ec_t *ec) {
+	(void)atomic_fetch_add(&ec->waiters, 1);
+	return (atomic_load(&ec->seq));
+}
+
+void
+ll_ec_cancel(ll_ec_t *ec) {
+	unsigned int old = atomic_fetch_sub(&ec->waiters, 1);
+	assert(old > 0);
+	(void)old;
+}
+
+void
+ll_ec_wait(ll_ec_t *ec, unsigned int key) {
+	(void)ll_ec_timedwait(ec, key, -1);
+}
+
+int
+ll_ec_timedwait(ll_ec_t *ec, unsigned int key, long timeout_ns) {
+	struct timespec ts = { .tv_sec = timeout_ns / 1000000000L, .tv_nsec = timeout_ns % 1000000000L };
+	int result = 0;
+
+	if (atomic_load(&ec->seq) == key) {
+		if (futex(&ec->seq, FUTEX_WAIT_PRIVATE, key, (timeout_ns < 0) ? NULL : &ts) == -1 &&
+		    errno == ETIMEDOUT) {
+			result = -1;
+		}
+	}
+	ll_ec_cancel(ec);
+
+	return (result);
+}
+
+void
+ll_ec_notify(ll_ec_t *ec, int count) {
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&ec->waiters) == 0) {
+		return;
+	}
+	(void)atomic_fetch_add(&ec->seq, 1);
+	(void)futex(&ec->seq, FUTEX_WAKE_PRIVATE, (unsigned int)count, NULL);
+}
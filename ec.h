@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+
+/*%
+ * Event count.
+ *
+ * An event count lets threads sleep until a condition that is checked
+ * without locks becomes true, without missing a wake-up.  The waiter
+ * takes a key first, checks the condition again, and sleeps only if
+ * nothing happened since the key was taken:
+ *
+ *	for (;;) {
+ *		if (condition) break;
+ *		unsigned int key = ll_ec_prepare(&ec);
+ *		if (condition) { ll_ec_cancel(&ec); break; }
+ *		ll_ec_wait(&ec, key);
+ *	}
+ *
+ * The notifier makes the condition true and calls ll_ec_notify(), which
+ * costs a single load when nobody is waiting.  Sleeping is done with
+ * futex(2).
+ */
+
+typedef struct ll_ec {
+	atomic_uint seq;
+	atomic_uint waiters;
+} ll_ec_t;
+
+void
+ll_ec_init(ll_ec_t *ec);
+/*%<
+ * Initialize the event count.
+ */
+
+unsigned int
+ll_ec_prepare(ll_ec_t *ec);
+/*%<
+ * Announce that the current thread is about to wait, and return the key
+ * for ll_ec_wait().  Must be followed by ll_ec_wait() or ll_ec_cancel().
+ */
+
+void
+ll_ec_cancel(ll_ec_t *ec);
+/*%<
+ * Withdraw the announcement made by ll_ec_prepare().
+ */
+
+void
+ll_ec_wait(ll_ec_t *ec, unsigned int key);
+/*%<
+ * Sleep until ll_ec_notify() has been called after ll_ec_prepare()
+ * returned 'key'.  Spurious wake-ups are possible, the caller must check
+ * the condition again.
+ */
+
+int
+ll_ec_timedwait(ll_ec_t *ec, unsigned int key, long timeout_ns);
+/*%<
+ * Same as ll_ec_wait(), but give up after 'timeout_ns' nanoseconds.
+ * Returns 0 when woken up (or spuriously), -1 on timeout.
+ */
+
+void
+ll_ec_notify(ll_ec_t *ec, int count);
+/*%<
+ * Wake up to 'count' waiting threads (INT_MAX for all of them).  Must be
+ * called after the condition the waiters check has been made true.
+ *
+ * Progress condition: wait-free population oblivious when no thread
+ * is waiting.
+ */
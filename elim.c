@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "cm.h"
+#include "elim.h"
+
+#define ELIM_SLOTS 8  /* Must be a power of two */
+#define ELIM_SPINS 64 /* Rounds a push waits in its slot for a pop */
+
+/*
+ * A slot holds 0, an offered value, or ELIM_TAKEN.  The pop takes the value
+ * by swapping it for ELIM_TAKEN, the push withdraws an offer nobody took by
+ * swapping it back for 0.  Exactly one of the two CASes succeeds, and only
+ * the push resets a taken slot, so a slot holds at most one offer at any
+ * time.
+ */
+typedef struct elim_slot {
+	alignas(64) atomic_uintptr_t value;
+} elim_slot_t;
+
+struct ll_elim {
+	elim_slot_t slots[ELIM_SLOTS];
+};
+
+static const char elim_taken;
+#define ELIM_TAKEN ((uintptr_t)&elim_taken)
+
+static thread_local uint32_t seed_v = 0;
+
+/* xorshift32, to pick the slots */
+static inline uint32_t
+elim_random(void) {
+	if (seed_v == 0) {
+		seed_v = (uint32_t)(uintptr_t)&seed_v | 1;
+	}
+	seed_v ^= seed_v << 13;
+	seed_v ^= seed_v >> 17;
+	seed_v ^= seed_v << 5;
+	return (seed_v);
+}
+
+ll_elim_t *
+ll_elim_new(void) {
+	ll_elim_t *elim = aligned_alloc(128, sizeof(*elim));
+	assert(elim != NULL);
+
+	for (size_t i = 0; i < ELIM_SLOTS; i++) {
+		atomic_init(&elim->slots[i].value, 0);
+	}
+
+	return (elim);
+}
+
+void
+ll_elim_destroy(ll_elim_t *elim) {
+	assert(elim != NULL);
+	free(elim);
+}
+
+bool
+ll_elim_push(ll_elim_t *elim, void *value) {
+	elim_slot_t *slot = &elim->slots[elim_random() & (ELIM_SLOTS - 1)];
+	uintptr_t empty = 0;
+
+	assert(value != NULL);
+
+	if (!atomic_compare_exchange_strong(&slot->value, &empty, (uintptr_t)value)) {
+		return (false);
+	}
+	for (unsigned int i = 0; i < ELIM_SPINS; i++) {
+		if (atomic_load_explicit(&slot->value, memory_order_relaxed) == ELIM_TAKEN) {
+			break;
+		}
+		ll_cm_pause();
+	}
+	uintptr_t offer = (uintptr_t)value;
+	if (atomic_compare_exchange_strong(&slot->value, &offer, 0)) {
+		return (false);
+	}
+	assert(offer == ELIM_TAKEN);
+	atomic_store(&slot->value, 0);
+
+	return (true);
+}
+
+void *
+ll_elim_pop(ll_elim_t *elim) {
+	uint32_t start = elim_random();
+
+	for (uint32_t i = 0; i < ELIM_SLOTS; i++) {
+		elim_slot_t *slot = &elim->slots[(start + i) & (ELIM_SLOTS - 1)];
+		uintptr_t offer = atomic_load(&slot->value);
+		if (offer != 0 && offer != ELIM_TAKEN && atomic_compare_exchange_strong(&slot->value, &offer, ELIM_TAKEN)) {
+			return ((void *)offer);
+		}
+	}
+
+	return (NULL);
+}
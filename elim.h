@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/*%
+ * Elimination array.
+ *
+ * This is the elimination layer from Danny Hendler, Nir Shavit and Lena
+ * Yerushalmi: A Scalable Lock-free Stack Algorithm.  A push and a pop
+ * that collide on the same end of a stack (or a deque) can cancel each
+ * other out: the push hands its value directly to the pop, and neither
+ * of them touches the data structure.  The pair is linearized as the push
+ * immediately followed by the pop.
+ *
+ * The data structure tries the elimination after a failed CAS, in place
+ * of (or before) backing off.  The values are opaque non-NULL pointers.
+ */
+
+typedef struct ll_elim ll_elim_t;
+
+ll_elim_t *
+ll_elim_new(void);
+/*%<
+ * Create a new elimination array.
+ */
+
+void
+ll_elim_destroy(ll_elim_t *elim);
+/*%<
+ * Destroy the elimination array.  No other thread may be using it.
+ */
+
+bool
+ll_elim_push(ll_elim_t *elim, void *value);
+/*%<
+ * Offer 'value' in a random slot and wait a moment for a pop to take it.
+ * Returns true if a pop took the value, false if the offer has been
+ * withdrawn and the caller still owns the value.
+ *
+ * Progress condition: wait-free bounded.
+ */
+
+void *
+ll_elim_pop(ll_elim_t *elim);
+/*%<
+ * Take a value offered by a concurrent ll_elim_push(), or return NULL if
+ * there is none.
+ *
+ * Progress condition: wait-free bounded.
+ */
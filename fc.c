@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cm.h"
+#include "fc.h"
+#include "tid.h"
+
+#define FC_PASSES      3    /* Scans of the slots per combining session */
+#define FC_SPINS       1024 /* Rounds of waiting for the combiner before yielding */
+#define FC_WINDOW      256  /* Operations of a thread between two evaluations */
+#define FC_ON_FAILURES 50   /* Failed CAS attempts per 100 operations that turn the combining on */
+#define FC_MIN_BATCH   2    /* Operations per session below which the combining turns off */
+
+enum {
+	FC_EMPTY,
+	FC_PENDING,
+	FC_DONE,
+};
+
+/* Each slot is written by its owner and by the combiner only */
+typedef struct fc_slot {
+	alignas(128) atomic_uint state;
+	unsigned int op;
+	uintptr_t arg;
+	uintptr_t result;
+	atomic_uint_fast64_t ops; /* operations counted by ll_fc_combining(), written by the owner only */
+} fc_slot_t;
+
+struct ll_fc {
+	ll_fc_apply_t *apply;
+	void *ctx;
+	ll_cm_t *cm;
+	atomic_int mode;
+	atomic_bool combining; /* the adaptive mode is combining now */
+	atomic_int nslots;     /* highest slot in use + 1 */
+	alignas(128) atomic_bool lock;
+	atomic_uint_fast64_t combined; /* written by the combiner only */
+	atomic_uint_fast64_t sessions; /* written by the combiner only */
+	alignas(128) atomic_flag adapting;
+	uint64_t sample_ops;
+	uint64_t sample_failures;
+	uint64_t sample_combined;
+	uint64_t sample_sessions;
+	fc_slot_t slots[LL_TID_MAX];
+};
+
+ll_fc_t *
+ll_fc_new(ll_fc_apply_t *apply, void *ctx, ll_cm_t *cm, ll_fc_mode_t mode) {
+	ll_fc_t *fc = aligned_alloc(128, sizeof(*fc));
+	assert(fc != NULL);
+	assert(apply != NULL);
+	assert(cm != NULL);
+
+	fc->apply = apply;
+	fc->ctx = ctx;
+	fc->cm = cm;
+	atomic_init(&fc->mode, mode);
+	atomic_init(&fc->combining, false);
+	atomic_init(&fc->nslots, 0);
+	atomic_init(&fc->lock, false);
+	atomic_init(&fc->combined, 0);
+	atomic_init(&fc->sessions, 0);
+	atomic_flag_clear(&fc->adapting);
+	fc->sample_ops = 0;
+	fc->sample_failures = ll_cm_failures(cm);
+	fc->sample_combined = 0;
+	fc->sample_sessions = 0;
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		atomic_init(&fc->slots[i].state, FC_EMPTY);
+		atomic_init(&fc->slots[i].ops, 0);
+	}
+
+	return (fc);
+}
+
+void
+ll_fc_destroy(ll_fc_t *fc) {
+	assert(fc != NULL);
+	free(fc);
+}
+
+void
+ll_fc_set_mode(ll_fc_t *fc, ll_fc_mode_t mode) {
+	atomic_store_explicit(&fc->mode, mode, memory_order_relaxed);
+}
+
+static fc_slot_t *
+fc_slot(ll_fc_t *fc) {
+	int id = ll_tid();
+	int nslots = atomic_load_explicit(&fc->nslots, memory_order_relaxed);
+
+	while (nslots <= id) {
+		if (atomic_compare_exchange_weak(&fc->nslots, &nslots, id + 1)) {
+			break;
+		}
+	}
+
+	return (&fc->slots[id]);
+}
+
+/*
+ * Compare the last window with the previous sample.  While not combining,
+ * the failed CAS attempts per operation decide; while combining, there
+ * are hardly any failures left, so the size of the batches decides.
+ */
+static void
+fc_adapt(ll_fc_t *fc) {
+	uint64_t ops = 0;
+
+	if (atomic_flag_test_and_set_explicit(&fc->adapting, memory_order_acquire)) {
+		return;
+	}
+
+	int nslots = atomic_load_explicit(&fc->nslots, memory_order_relaxed);
+	for (int i = 0; i < nslots; i++) {
+		ops += atomic_load_explicit(&fc->slots[i].ops, memory_order_relaxed);
+	}
+	uint64_t failures = ll_cm_failures(fc->cm);
+	uint64_t combined = atomic_load_explicit(&fc->combined, memory_order_relaxed);
+	uint64_t sessions = atomic_load_explicit(&fc->sessions, memory_order_relaxed);
+
+	uint64_t d_ops = ops - fc->sample_ops;
+	uint64_t d_failures = failures - fc->sample_failures;
+	uint64_t d_combined = combined - fc->sample_combined;
+	uint64_t d_sessions = sessions - fc->sample_sessions;
+
+	if (atomic_load_explicit(&fc->combining, memory_order_relaxed)) {
+		if (d_sessions > 0 && d_combined < FC_MIN_BATCH * d_sessions) {
+			atomic_store_explicit(&fc->combining, false, memory_order_relaxed);
+		}
+	} else if (d_ops > 0 && d_failures * 100 >= d_ops * FC_ON_FAILURES) {
+		atomic_store_explicit(&fc->combining, true, memory_order_relaxed);
+	}
+
+	fc->sample_ops = ops;
+	fc->sample_failures = failures;
+	fc->sample_combined = combined;
+	fc->sample_sessions = sessions;
+
+	atomic_flag_clear_explicit(&fc->adapting, memory_order_release);
+}
+
+bool
+ll_fc_combining(ll_fc_t *fc) {
+	switch (atomic_load_explicit(&fc->mode, memory_order_relaxed)) {
+	case LL_FC_OFF:
+		return (false);
+	case LL_FC_ON:
+		return (true);
+	case LL_FC_ADAPTIVE:
+		break;
+	default:
+		assert(0);
+	}
+
+	fc_slot_t *slot = fc_slot(fc);
+	uint_fast64_t ops = atomic_load_explicit(&slot->ops, memory_order_relaxed) + 1;
+	atomic_store_explicit(&slot->ops, ops, memory_order_relaxed);
+	if (ops % FC_WINDOW == 0) {
+		fc_adapt(fc);
+	}
+
+	return (atomic_load_explicit(&fc->combining, memory_order_relaxed));
+}
+
+static void
+fc_combine(ll_fc_t *fc) {
+	uint64_t applied = 0;
+
+	for (size_t pass = 0; pass < FC_PASSES; pass++) {
+		int nslots = atomic_load_explicit(&fc->nslots, memory_order_relaxed);
+		uint64_t found = 0;
+		for (int i = 0; i < nslots; i++) {
+			fc_slot_t *slot = &fc->slots[i];
+			if (atomic_load_explicit(&slot->state, memory_order_acquire) != FC_PENDING) {
+				continue;
+			}
+			slot->result = fc->apply(fc->ctx, slot->op, slot->arg);
+			atomic_store_explicit(&slot->state, FC_DONE, memory_order_release);
+			found++;
+		}
+		if (found == 0) {
+			break;
+		}
+		applied += found;
+	}
+
+	atomic_store_explicit(&fc->combined, atomic_load_explicit(&fc->combined, memory_order_relaxed) + applied,
+			      memory_order_relaxed);
+	atomic_store_explicit(&fc->sessions, atomic_load_explicit(&fc->sessions, memory_order_relaxed) + 1,
+			      memory_order_relaxed);
+}
+
+uintptr_t
+ll_fc_execute(ll_fc_t *fc, unsigned int op, uintptr_t arg) {
+	fc_slot_t *slot = fc_slot(fc);
+	unsigned int spins = 0;
+
+	slot->op = op;
+	slot->arg = arg;
+	atomic_store_explicit(&slot->state, FC_PENDING, memory_order_release);
+
+	while (atomic_load_explicit(&slot->state, memory_order_acquire) != FC_DONE) {
+		if (!atomic_load_explicit(&fc->lock, memory_order_relaxed) &&
+		    !atomic_exchange_explicit(&fc->lock, true, memory_order_acquire)) {
+			fc_combine(fc);
+			atomic_store_explicit(&fc->lock, false, memory_order_release);
+			continue;
+		}
+		if (spins++ < FC_SPINS) {
+			ll_cm_pause();
+		} else {
+			(void)sched_yield();
+		}
+	}
+
+	atomic_store_explicit(&slot->state, FC_EMPTY, memory_order_relaxed);
+	return (slot->result);
+}
+
+uint64_t
+ll_fc_combined(ll_fc_t *fc) {
+	return (atomic_load_explicit(&fc->combined, memory_order_relaxed));
+}
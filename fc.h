@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "cm.h"
+
+/*%
+ * Flat combining.
+ *
+ * This is the technique from Danny Hendler, Itai Incze, Nir Shavit and
+ * Moran Tzafrir: Flat Combining and the Synchronization-Parallelism
+ * Tradeoff.  A thread publishes its operation in its own slot, and
+ * whichever thread manages to become the combiner applies all the
+ * published operations one after another, while the others spin on
+ * their slots for the result.
+ *
+ * The combiner applies the operations through the same lock-free code
+ * the threads would run on their own, it only makes sure that a single
+ * thread at a time hammers the contended links.  Operations that bypass
+ * the combiner therefore stay correct, and the combining can be turned
+ * on and off at any time.
+ *
+ * In the adaptive mode the combining turns on when the failed CAS
+ * attempts recorded by the contention manager of the data structure
+ * exceed a threshold, and turns off again when the combiner finds too
+ * few operations to batch.
+ */
+
+typedef struct ll_fc ll_fc_t;
+
+typedef enum ll_fc_mode {
+	LL_FC_OFF,	/* never combine */
+	LL_FC_ON,	/* always combine */
+	LL_FC_ADAPTIVE, /* combine while the data structure is contended */
+} ll_fc_mode_t;
+
+typedef uintptr_t(ll_fc_apply_t)(void *ctx, unsigned int op, uintptr_t arg);
+
+ll_fc_t *
+ll_fc_new(ll_fc_apply_t *apply, void *ctx, ll_cm_t *cm, ll_fc_mode_t mode);
+/*%<
+ * Create a new combiner that applies the operations with 'apply(ctx, op,
+ * arg)'.  The failure counts of 'cm' drive the adaptive mode.
+ */
+
+void
+ll_fc_destroy(ll_fc_t *fc);
+/*%<
+ * Destroy the combiner.  No other thread may be using it.
+ */
+
+void
+ll_fc_set_mode(ll_fc_t *fc, ll_fc_mode_t mode);
+/*%<
+ * Switch the combiner to a different mode.  This is safe to call while
+ * other threads are using the combiner.
+ */
+
+bool
+ll_fc_combining(ll_fc_t *fc);
+/*%<
+ * Return true if the next operation should go through ll_fc_execute().
+ * In the adaptive mode this also counts the operation and occasionally
+ * re-evaluates the contention.
+ *
+ * Progress condition: wait-free bounded (by the number of threads).
+ */
+
+uintptr_t
+ll_fc_execute(ll_fc_t *fc, unsigned int op, uintptr_t arg);
+/*%<
+ * Publish the operation, wait until a combiner has applied it, and
+ * return its result.  The calling thread becomes the combiner itself
+ * when nobody else is.
+ *
+ * Progress condition: blocking, a preempted combiner holds up the
+ * threads waiting for it.
+ */
+
+uint64_t
+ll_fc_combined(ll_fc_t *fc);
+/*%<
+ * Return the number of operations applied by the combiners so far.
+ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "hist.h"
+
+#define HIST_SUB_BITS 5 /* 32 sub-buckets per power of two, a relative error of 1/32 */
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+
+/*
+ * The values below 2 * HIST_SUB have a bucket each.  A larger value with
+ * its top bit at 'msb' is shifted right by e = msb - HIST_SUB_BITS, which
+ * leaves a mantissa in [HIST_SUB, 2 * HIST_SUB), and lands in the bucket
+ * e * HIST_SUB + mantissa; the buckets of consecutive exponents follow
+ * each other without a gap.
+ */
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct ll_hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+static inline unsigned int
+hist_bucket(uint64_t value) {
+	if (value < 2 * HIST_SUB) {
+		return ((unsigned int)value);
+	}
+	unsigned int e = 63 - (unsigned int)__builtin_clzll(value) - HIST_SUB_BITS;
+	return (e * HIST_SUB + (unsigned int)(value >> e));
+}
+
+/* The largest value that lands in 'bucket' */
+static inline uint64_t
+hist_value(unsigned int bucket) {
+	if (bucket < 2 * HIST_SUB) {
+		return (bucket);
+	}
+	unsigned int e = bucket / HIST_SUB - 1;
+	uint64_t mantissa = bucket % HIST_SUB + HIST_SUB;
+	return (((mantissa + 1) << e) - 1);
+}
+
+ll_hist_t *
+ll_hist_new(void) {
+	ll_hist_t *hist = calloc(1, sizeof(*hist));
+	assert(hist != NULL);
+	return (hist);
+}
+
+void
+ll_hist_destroy(ll_hist_t *hist) {
+	assert(hist != NULL);
+	free(hist);
+}
+
+void
+ll_hist_record(ll_hist_t *hist, uint64_t value) {
+	hist->buckets[hist_bucket(value)]++;
+	hist->count++;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+void
+ll_hist_merge(ll_hist_t *dst, const ll_hist_t *src) {
+	for (size_t i = 0; i < HIST_BUCKETS; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+}
+
+uint64_t
+ll_hist_count(const ll_hist_t *hist) {
+	return (hist->count);
+}
+
+uint64_t
+ll_hist_max(const ll_hist_t *hist) {
+	return (hist->max);
+}
+
+uint64_t
+ll_hist_percentile(const ll_hist_t *hist, double percentile) {
+	if (hist->count == 0) {
+		return (0);
+	}
+
+	uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)hist->count);
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			uint64_t value = hist_value(i);
+			return ((value < hist->max) ? value : hist->max);
+		}
+	}
+
+	return (hist->max);
+}
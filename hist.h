@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+/*%
+ * Log-bucketed histogram of 64-bit values, after Gil Tene's HdrHistogram.
+ *
+ * Every power of two is split into the same number of linear sub-buckets,
+ * so a recorded value is known to within about 3% of itself however big
+ * it is, and recording costs a count-leading-zeros and an increment.  The
+ * small values are counted exactly.
+ *
+ * A histogram is not thread-safe: every thread records to its own one and
+ * the histograms are merged at the end.
+ */
+
+typedef struct ll_hist ll_hist_t;
+
+ll_hist_t *
+ll_hist_new(void);
+/*%<
+ * Create a new empty histogram.
+ */
+
+void
+ll_hist_destroy(ll_hist_t *hist);
+/*%<
+ * Destroy the histogram.
+ */
+
+void
+ll_hist_record(ll_hist_t *hist, uint64_t value);
+/*%<
+ * Count 'value' in the histogram.
+ */
+
+void
+ll_hist_merge(ll_hist_t *dst, const ll_hist_t *src);
+/*%<
+ * Add the counts of 'src' to 'dst'.
+ */
+
+uint64_t
+ll_hist_count(const ll_hist_t *hist);
+/*%<
+ * Return the number of recorded values.
+ */
+
+uint64_t
+ll_hist_max(const ll_hist_t *hist);
+/*%<
+ * Return the largest recorded value, exactly, or 0 if the histogram is
+ * empty.
+ */
+
+uint64_t
+ll_hist_percentile(const ll_hist_t *hist, double percentile);
+/*%<
+ * Return the value below or at which 'percentile' percent of the recorded
+ * values lie, rounded up to the top of its sub-bucket and capped at the
+ * largest recorded value; or 0 if the histogram is empty.
+ */
@@ -48,54 +48,51 @@
 #include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
-#include <threads.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "hp.h"
+#include "tid.h"
 
-#define HP_MAX_THREADS 128
-static int ll__hp_max_threads = HP_MAX_THREADS;
+static int ll__hp_max_threads = LL_TID_MAX;
 #define HP_MAX_HPS     5 /* This is named 'K' in the HP paper */
 #define CLPAD	       (128 / sizeof(uintptr_t))
-#define HP_THRESHOLD_R 0 /* This is named 'R' in the HP paper */
-
-/* Maximum number of retired objects per thread */
-static int ll__hp_max_retired = HP_MAX_THREADS * HP_MAX_HPS;
-
-#define TID_UNKNOWN -1
-
-static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
-
-static thread_local int tid_v = TID_UNKNOWN;
+#define HP_THRESHOLD_R 16 /* This is named 'R' in the HP paper */
 
 typedef struct retirelist {
 	int size;
+	int capacity;
+	bool scanning;
 	uintptr_t *list;
+	uintptr_t *hazards; /* The snapshot of the hazard pointers taken by the scan */
 } retirelist_t;
 
 struct ll_hp {
 	int max_hps;
-	alignas(128) atomic_uintptr_t *hp[HP_MAX_THREADS];
-	alignas(128) retirelist_t *rl[HP_MAX_THREADS*CLPAD];
+	int max_retired; /* Initial size of the retire list of every thread, it grows when needed */
+	alignas(128) atomic_uintptr_t *hp[LL_TID_MAX];
+	alignas(128) retirelist_t *rl[LL_TID_MAX*CLPAD];
 	ll_hp_deletefunc_t *deletefunc;
 };
 
+/* The ids are shared with the other modules, ll_hp_init() may have set a lower limit */
 static inline int
 tid(void) {
-	if (tid_v == TID_UNKNOWN) {
-		tid_v = atomic_fetch_add(&tid_v_base, 1);
-		assert(tid_v < ll__hp_max_threads);
-	}
+	int id = ll_tid();
+	assert(id < ll__hp_max_threads);
 
-	return (tid_v);
+	return (id);
 }
 
 void
 ll_hp_init(int max_threads) {
 	ll__hp_max_threads = max_threads;
-	ll__hp_max_retired = max_threads * HP_MAX_HPS;
+}
+
+void
+ll_hp_register(void) {
+	(void)tid();
 }
 
 ll_hp_t *
@@ -105,8 +102,13 @@ ll_hp_new(size_t max_hps, ll_hp_deletefunc_t *deletefunc) {
 	if (max_hps == 0) {
 		max_hps = HP_MAX_HPS;
 	}
+	assert(max_hps <= CLPAD * 2);
 
-	*hp = (ll_hp_t){ .max_hps = max_hps, .deletefunc = deletefunc };
+	*hp = (ll_hp_t){
+		.max_hps = max_hps,
+		.max_retired = ll__hp_max_threads * (max_hps > HP_MAX_HPS ? max_hps : HP_MAX_HPS),
+		.deletefunc = deletefunc
+	};
 
 	for (int i = 0; i < ll__hp_max_threads; i++) {
 		hp->hp[i] = calloc(CLPAD * 2, sizeof(hp->hp[i][0]));
@@ -114,7 +116,8 @@ ll_hp_new(size_t max_hps, ll_hp_deletefunc_t *deletefunc) {
 		for (int j = 0; j < hp->max_hps; j++) {
 			atomic_init(&hp->hp[i][j], 0);
 		}
-		hp->rl[i*CLPAD]->list = calloc(ll__hp_max_retired, sizeof(uintptr_t));
+		hp->rl[i*CLPAD]->capacity = hp->max_retired;
+		hp->rl[i*CLPAD]->list = calloc(hp->max_retired, sizeof(uintptr_t));
 	}
 
 	return (hp);
@@ -130,6 +133,7 @@ ll_hp_destroy(ll_hp_t *hp) {
 			hp->deletefunc(data);
 		}
 		free(rl->list);
+		free(rl->hazards);
 		free(rl);
 	}
 	free(hp);
@@ -170,33 +174,92 @@ ll_hp_protect_release(ll_hp_t *hp, int ihp, uintptr_t ptr) {
 	return (ptr);
 }
 
-void
-ll_hp_retire(ll_hp_t *hp, uintptr_t ptr) {
-	retirelist_t *rl = hp->rl[tid()*CLPAD];
-	rl->list[rl->size++] = ptr;
-	assert(rl->size < ll__hp_max_retired);
+static int
+hp_compare(const void *a, const void *b) {
+	uintptr_t x = *(const uintptr_t *)a;
+	uintptr_t y = *(const uintptr_t *)b;
 
-	if (rl->size < HP_THRESHOLD_R) {
-		return;
+	return ((x > y) - (x < y));
+}
+
+/*
+ * Only the threads that have been given an id can hold a hazard pointer, the
+ * scan does not need to look any further.
+ */
+static inline int
+hp_threads(void) {
+	int threads = ll_tid_count();
+
+	return ((threads < ll__hp_max_threads) ? threads : ll__hp_max_threads);
+}
+
+static void
+hp_scan(ll_hp_t *hp, retirelist_t *rl) {
+	int threads = hp_threads();
+	size_t nhazards = 0;
+
+	if (rl->hazards == NULL) {
+		rl->hazards = calloc(ll__hp_max_threads * hp->max_hps, sizeof(rl->hazards[0]));
+		assert(rl->hazards != NULL);
 	}
 
-	for (size_t iret = 0; iret < rl->size; iret++) {
-		uintptr_t obj = rl->list[iret];
-		bool can_delete = true;
-		for (int itid = 0; itid < ll__hp_max_threads && can_delete; itid++) {
-			for (int ihp = hp->max_hps - 1; ihp >= 0; ihp--) {
-				if (atomic_load(&hp->hp[itid][ihp]) == obj) {
-					can_delete = false;
-					break;
-				}
+	/* Read every hazard pointer once, then look the retired objects up in the sorted copy */
+	for (int itid = 0; itid < threads; itid++) {
+		for (int ihp = 0; ihp < hp->max_hps; ihp++) {
+			uintptr_t obj = atomic_load(&hp->hp[itid][ihp]);
+			if (obj != 0) {
+				rl->hazards[nhazards++] = obj;
 			}
 		}
+	}
+	qsort(rl->hazards, nhazards, sizeof(rl->hazards[0]), hp_compare);
 
-		if (can_delete) {
-			size_t bytes = (rl->size - iret) * sizeof(rl->list[0]);
-			memmove(&rl->list[iret], &rl->list[iret + 1], bytes);
-			rl->size--;
-			hp->deletefunc((void *)obj);
+	/* Keep the protected objects at the front, move the others to the back */
+	int size = rl->size;
+	int kept = 0;
+	for (int iret = 0; iret < size; iret++) {
+		uintptr_t obj = rl->list[iret];
+		if (bsearch(&obj, rl->hazards, nhazards, sizeof(rl->hazards[0]), hp_compare) != NULL) {
+			rl->list[iret] = rl->list[kept];
+			rl->list[kept++] = obj;
 		}
 	}
+
+	/*
+	 * The delete function may retire more objects, they are appended after
+	 * 'size' and must not be overwritten; move them down once all the
+	 * unprotected objects are gone.
+	 */
+	rl->scanning = true;
+	for (int iret = kept; iret < size; iret++) {
+		hp->deletefunc((void *)rl->list[iret]);
+	}
+	rl->scanning = false;
+
+	int appended = rl->size - size;
+	memmove(&rl->list[kept], &rl->list[size], appended * sizeof(rl->list[0]));
+	rl->size = kept + appended;
+}
+
+void
+ll_hp_retire(ll_hp_t *hp, uintptr_t ptr) {
+	retirelist_t *rl = hp->rl[tid()*CLPAD];
+
+	if (rl->size == rl->capacity) {
+		rl->capacity *= 2;
+		rl->list = realloc(rl->list, rl->capacity * sizeof(rl->list[0]));
+		assert(rl->list != NULL);
+	}
+	rl->list[rl->size++] = ptr;
+
+	/*
+	 * The scan costs one pass over the hazard pointers of all the threads;
+	 * waiting until the retired objects outnumber the hazard pointers makes
+	 * sure that every scan frees at least HP_THRESHOLD_R objects.
+	 */
+	if (rl->scanning || rl->size < hp_threads() * hp->max_hps + HP_THRESHOLD_R) {
+		return;
+	}
+
+	hp_scan(hp, rl);
 }
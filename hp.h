@@ -66,8 +66,19 @@ typedef void(ll_hp_deletefunc_t)(void *);
 void
 ll_hp_init(int max_threads);
 /*%<
- * Initialize hazard pointer constants - ll__hp_max_threads. If more threads
- * will try to access hp it will assert.
+ * Initialize hazard pointer constants - ll__hp_max_threads, at most
+ * LL_TID_MAX (see tid.h). If more threads will try to access hp it will
+ * assert.
+ */
+
+void
+ll_hp_register(void);
+/*%<
+ * Assign the thread id (see tid.h) to the current thread now instead of
+ * on its first use.  Long-lived threads (e.g. the scheduler workers)
+ * should call this when they start, so they get the lowest ids and
+ * running out of ids fails early rather than in the middle of an
+ * operation.
  */
 
 ll_hp_t *
@@ -132,7 +143,13 @@ void
 ll_hp_retire(ll_hp_t *hp, uintptr_t ptr);
 /*%<
  * Retire an object that is no longer in use by any thread, calling
- * the delete function that was specified in ll_hp_new().
+ * the delete function that was specified in ll_hp_new().  The retired
+ * objects are collected per thread and the hazard pointers are scanned
+ * only once there are more of them than there are hazard pointers, so
+ * a thread holds back up to twice as many objects as there are hazard
+ * pointers in use, plus a small constant.  The delete function may
+ * retire more objects.
  *
- * Progress condition: wait-free bounded (by the number of threads squared)
+ * Progress condition: wait-free bounded (by the number of threads squared),
+ * amortized O(log(number of hazard pointers)) per retired object.
  */
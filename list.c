@@ -1,48 +1,70 @@
 #include <assert.h>
-#include <pthread.h>
+#include <errno.h>
 #include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
-#include <stdio.h>
-#include <threads.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "bloom.h"
+#include "cm.h"
+#include "fc.h"
 #include "hp.h"
+#include "ll_list.h"
+#include "mwcas.h"
+#include "pool.h"
 
-#define NELEMENTS 128
-#define NTHREADS 128 / 4
-#define MAX_THREADS 128
-
-static atomic_uint_fast32_t deletes = 0;
-static atomic_uint_fast32_t inserts = 0;
-
-/* PUBLIC */
-
-typedef uintptr_t ll_key_t;
 typedef struct ll_node ll_node_t;
-typedef struct ll_list ll_list_t;
-
-ll_list_t *
-ll_list_new(void);
-void
-ll_list_destroy(ll_list_t *);
-bool
-ll_list_insert(ll_list_t *list, ll_key_t key);
-bool
-ll_list_delete(ll_list_t *list, ll_key_t key);
-bool
-ll_list_contains(ll_list_t *list, ll_key_t key);
 
 /* PRIVATE */
 
 #define HP_NEXT 0
 #define HP_CURR 1
 #define HP_PREV 2
+#define HP_HEAD 3 /* the chain the operation runs on, see ll_list_clear() */
 
 #define ALIGNMENT 128
 
+/*
+ * Memory orderings.  A hazard pointer protects a node only if the load that validates it is ordered after the store
+ * that publishes it, and a node can be reclaimed only if the CAS that unlinks it is ordered before the scan of the
+ * hazard pointers in ll_hp_retire(); hp.c publishes and scans with seq_cst, so the validating loads and the unlinking
+ * CASes are seq_cst as well.  Every other access is as weak as the comment next to it explains.
+ *
+ * Build with -DLL_LIST_SEQ_CST to make every access seq_cst again, to compare against.
+ */
+#if defined(LL_LIST_SEQ_CST)
+#define LL__RELAXED memory_order_seq_cst
+#define LL__RELEASE memory_order_seq_cst
+#else
+#define LL__RELAXED memory_order_relaxed
+#define LL__RELEASE memory_order_release
+#endif
+#define LL__SEQ_CST memory_order_seq_cst
+
 /* Santa's Little Helpers */
 
+/*
+ * Load a link, looking through the ll_list_move() that may be changing it.  The links take part in the multi-word CAS
+ * of the moves, so they are never read otherwise when the value is used.
+ */
+static inline uintptr_t
+ll__list_load(atomic_uintptr_t *link, memory_order order) {
+	uintptr_t value = atomic_load_explicit(link, order);
+	return (ll_mwcas_is_descriptor(value) ? ll_mwcas_read(link) : value);
+}
+
+/* A CAS on a link failed on a move in progress, which must not hold the writer up */
+static inline void
+ll__list_resolve(atomic_uintptr_t *link, uintptr_t value) {
+	if (ll_mwcas_is_descriptor(value)) {
+		ll_mwcas_resolve(link);
+	}
+}
+
 #define is_marked(p) (bool)((uintptr_t)(p) & 0x01)
 #define get_marked(p) ((uintptr_t)(p) | (0x01))
 #define get_unmarked(p) ((uintptr_t)(p) & (~0x01))
@@ -52,6 +74,7 @@ ll_list_contains(ll_list_t *list, ll_key_t key);
 
 struct ll_node {
 	alignas(128) uint32_t magic;
+	ll_list_t *list; /* the pool to return the node to */
 	alignas(128) atomic_uintptr_t next;
 	ll_key_t key;
 };
@@ -59,61 +82,110 @@ struct ll_node {
 /* Per list variables */
 
 struct ll_list {
-	atomic_uintptr_t head;
-	atomic_uintptr_t tail;
+	atomic_uintptr_t head; /* replaced as a whole by ll_list_clear(), compared by ll_list_move() */
 	ll_hp_t *hp;
+	ll_cm_t *cm;
+	ll_fc_t *fc;	   /* flat combining of insert and delete, off by default */
+	ll_bloom_t *bloom; /* optional negative-lookup filter */
+	ll_pool_t *pool;
 };
 
-ll_node_t *
-ll_node_new(ll_key_t key) {
-	ll_node_t *node = aligned_alloc(128, sizeof(*node));
-	assert(node != NULL);
-	*node = (ll_node_t){ .magic = 0xdeadbeaf, .key = key };
-	(void)atomic_fetch_add(&inserts, 1);
+static ll_node_t *
+ll_node_new(ll_list_t *list, ll_key_t key) {
+	ll_node_t *node = ll_pool_get(list->pool);
+	*node = (ll_node_t){ .magic = 0xdeadbeaf, .list = list, .key = key };
 	return (node);
 }
 
-void
+static void
 ll_node_destroy(ll_node_t *node) {
 	if (node == NULL) {
 		return;
 	}
 	assert(node->magic == 0xdeadbeaf);
-	free(node);
-	(void)atomic_fetch_add(&deletes, 1);
+	ll_pool_put(node->list->pool, node);
 }
 
+/*
+ * The hazard pointers retire single nodes, and whole chains swapped out by ll_list_clear(); a chain is retired as its
+ * head sentinel, the only node with the key 0.
+ */
 static void
 ll__list_node_delete(void *arg) {
 	ll_node_t *node = (ll_node_t *)arg;
-	ll_node_destroy(node);
+
+	if (node->key != 0) {
+		ll_node_destroy(node);
+		return;
+	}
+
+	/* Nobody runs on the chain anymore, the nodes unlinked from it have been retired on their own */
+	while (node != NULL) {
+		ll_node_t *next = get_unmarked_node(ll__list_load(&node->next, LL__RELAXED));
+		ll_node_destroy(node);
+		node = next;
+	}
+}
+
+/*
+ * Retry budget of a single operation, every traversal of the list counts as
+ * one attempt.  The budget with max == 0 is unbounded.
+ */
+typedef struct ll__budget {
+	size_t max;
+	size_t attempts;
+} ll__budget_t;
+
+static inline bool
+ll__budget_spend(ll__budget_t *budget) {
+	budget->attempts++;
+	return (budget->max == 0 || budget->attempts <= budget->max);
 }
 
+static inline bool
+ll__budget_exhausted(ll__budget_t *budget) {
+	return (budget->max != 0 && budget->attempts > budget->max);
+}
+
+/*
+ * Find the first node with a key not lower than 'key'.  The head of the chain the search ran on is stored to
+ * 'par_head' and stays protected by HP_HEAD; the caller must check with ll__list_moved() that the chain is still the
+ * list before it relies on the result, ll_list_clear() may have swapped it out meanwhile.
+ */
 static bool
-ll__list_find(ll_list_t *list, ll_key_t *key, atomic_uintptr_t **par_prev, ll_node_t **par_curr, ll_node_t **par_next) {
+ll__list_find(ll_list_t *list, ll_key_t *key, ll_node_t **par_head, atomic_uintptr_t **par_prev,
+	      ll_node_t **par_curr, ll_node_t **par_next, ll__budget_t *budget) {
 	atomic_uintptr_t *prev = NULL;
 	ll_node_t *curr = NULL, *next = NULL;
+	unsigned int backoff = 0;
 
 try_again:
+	if (!ll__budget_spend(budget)) {
+		return false;
+	}
 	prev = &list->head;
-	curr = (ll_node_t *)atomic_load(prev);
+	/* Not dereferenced before the validation below, which also acquires the node */
+	curr = (ll_node_t *)ll__list_load(prev, LL__RELAXED);
+	(void)ll_hp_protect_ptr(list->hp, HP_HEAD, (uintptr_t)curr);
 	(void)ll_hp_protect_ptr(list->hp, HP_CURR, (uintptr_t)curr);
-	if (atomic_load(prev) != get_unmarked(curr)) {
+	if (ll__list_load(prev, LL__SEQ_CST) != get_unmarked(curr)) {
+		ll_cm_backoff(list->cm, &backoff);
 		goto try_again;
 	}
+	*par_head = curr;
 	while (true) {
 		if (get_unmarked_node(curr) == NULL) {
 			return false;
 		}
-		next = (ll_node_t *)atomic_load(&get_unmarked_node(curr)->next);
+		/* Same as above */
+		next = (ll_node_t *)ll__list_load(&get_unmarked_node(curr)->next, LL__RELAXED);
 		(void)ll_hp_protect_ptr(list->hp, HP_NEXT, get_unmarked(next));
-		if (atomic_load(&get_unmarked_node(curr)->next) != (uintptr_t)next) {
-			break;
-		}
-		if (get_unmarked(next) == atomic_load((atomic_uintptr_t *)&list->tail)) {
-			break;
+		if (ll__list_load(&get_unmarked_node(curr)->next, LL__SEQ_CST) != (uintptr_t)next) {
+			ll_cm_backoff(list->cm, &backoff);
+			goto try_again;
 		}
-		if (atomic_load(prev) != get_unmarked(curr)) {
+		if (ll__list_load(prev, LL__SEQ_CST) != get_unmarked(curr)) {
+			ll_cm_backoff(list->cm, &backoff);
 			goto try_again;
 		}
 		if (get_unmarked_node(next) == next) {
@@ -127,206 +199,583 @@ try_again:
 			(void)ll_hp_protect_release(list->hp, HP_PREV, get_unmarked(curr));
 		} else {
 			uintptr_t tmp = get_unmarked(curr);
-			if (!atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next))) {
+			/* A failed CAS is followed by a fresh traversal, it need not order anything */
+			if (!atomic_compare_exchange_strong_explicit(prev, &tmp, get_unmarked(next), LL__SEQ_CST,
+								     LL__RELAXED)) {
+				ll__list_resolve(prev, tmp);
+				ll_cm_backoff(list->cm, &backoff);
 				goto try_again;
 			}
 			ll_hp_retire(list->hp, get_unmarked(curr));
 		}
-		curr = next;
-		(void)ll_hp_protect_release(list->hp, HP_CURR, get_unmarked(next));
+		/* The link to the successor of a deleted node is marked, the node returned must not be */
+		curr = get_unmarked_node(next);
+		(void)ll_hp_protect_release(list->hp, HP_CURR, (uintptr_t)curr);
 	}
-	*par_curr = curr;
-	*par_prev = prev;
-	*par_next = next;
-
-	return false;
 }
 
-/* PUBLIC */
+/*
+ * Whether the list has been cleared since ll__list_find() started on 'head'.  An operation that has seen or changed
+ * the old chain is then retried on the new one, as it may have happened after the clear.  HP_HEAD keeps the old head
+ * from being reused, so the comparison cannot be fooled by ABA.
+ */
+static inline bool
+ll__list_moved(ll_list_t *list, ll_node_t *head) {
+	return (ll__list_load(&list->head, LL__SEQ_CST) != (uintptr_t)head);
+}
 
-bool
-ll_list_insert(ll_list_t *list, ll_key_t key) {
-	ll_node_t *curr = NULL, *next = NULL;
+static ll_list_result_t
+ll__list_insert(ll_list_t *list, ll_key_t key, ll__budget_t *budget) {
+	ll_node_t *head = NULL, *curr = NULL, *next = NULL;
 	atomic_uintptr_t *prev = NULL;
+	unsigned int backoff = 0;
 
-	ll_node_t *node = ll_node_new(key);
+	ll_node_t *node = ll_node_new(list, key);
+
+	/* The filter must know about the key before the node is published */
+	if (list->bloom != NULL) {
+		ll_bloom_add(list->bloom, key);
+	}
 
 	while (true) {
-		if (ll__list_find(list, &key, &prev, &curr, &next)) {
+		bool found = ll__list_find(list, &key, &head, &prev, &curr, &next, budget);
+		if (found && ll__list_moved(list, head)) {
+			continue;
+		}
+		if (found || ll__budget_exhausted(budget)) {
+			if (list->bloom != NULL) {
+				ll_bloom_remove(list->bloom, key);
+			}
 			ll_node_destroy(node);
 			ll_hp_clear(list->hp);
-			return false;
+			return (found ? LL_LIST_FAILURE : LL_LIST_CONTENDED);
 		}
-		atomic_store_explicit(&node->next, (uintptr_t)curr, memory_order_relaxed);
+		/* The node is private until the CAS below publishes it */
+		atomic_store_explicit(&node->next, (uintptr_t)curr, LL__RELAXED);
 		uintptr_t tmp = get_unmarked(curr);
-		if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t)node)) {
+		/* Release: whoever reads the link to the node sees the key and the next link */
+		if (atomic_compare_exchange_strong_explicit(prev, &tmp, (uintptr_t)node, LL__RELEASE, LL__RELAXED)) {
+			if (ll__list_moved(list, head)) {
+				/* The node went down with the old chain, insert another one to the new chain */
+				node = ll_node_new(list, key);
+				if (list->bloom != NULL) {
+					ll_bloom_add(list->bloom, key);
+				}
+				continue;
+			}
 			ll_hp_clear(list->hp);
-			return true;
+			return LL_LIST_SUCCESS;
 		}
+		ll__list_resolve(prev, tmp);
+		ll_cm_backoff(list->cm, &backoff);
 	}
 }
 
-bool
-ll_list_delete(ll_list_t *list, ll_key_t key) {
-	ll_node_t *curr, *next;
+static ll_list_result_t
+ll__list_delete(ll_list_t *list, ll_key_t key, ll__budget_t *budget) {
+	ll_node_t *head, *curr, *next;
 	atomic_uintptr_t *prev;
+	unsigned int backoff = 0;
 	while (true) {
-		if (!ll__list_find(list, &key, &prev, &curr, &next)) {
+		if (!ll__list_find(list, &key, &head, &prev, &curr, &next, budget)) {
+			if (!ll__budget_exhausted(budget) && ll__list_moved(list, head)) {
+				continue;
+			}
 			ll_hp_clear(list->hp);
-			return false;
+			return (ll__budget_exhausted(budget) ? LL_LIST_CONTENDED : LL_LIST_FAILURE);
 		}
 
 		uintptr_t tmp = get_unmarked(next);
 
-		if (!atomic_compare_exchange_strong(&curr->next, &tmp, get_marked(next))) {
+		/*
+		 * Relaxed: the mark publishes nothing new, the read-modify-write keeps the link in the release sequence of
+		 * the store that linked 'next', so who reads the marked link still sees 'next' initialized.
+		 */
+		if (!atomic_compare_exchange_strong_explicit(&curr->next, &tmp, get_marked(next), LL__RELAXED,
+							     LL__RELAXED)) {
+			ll__list_resolve(&curr->next, tmp);
+			ll_cm_backoff(list->cm, &backoff);
+			continue;
+		}
+
+		/* The key is logically deleted, it can leave the filter now */
+		if (list->bloom != NULL) {
+			ll_bloom_remove(list->bloom, key);
+		}
+
+		if (ll__list_moved(list, head)) {
+			/* Deleted from the old chain, which is not the list anymore */
 			continue;
 		}
 
 		tmp = get_unmarked(curr);
-		if (atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next))) {
+		if (atomic_compare_exchange_strong_explicit(prev, &tmp, get_unmarked(next), LL__SEQ_CST, LL__RELAXED)) {
 			ll_hp_clear(list->hp);
 			ll_hp_retire(list->hp, get_unmarked(curr));
 		} else {
-			/* ll__list_find(list, &key, &prev, &curr, &next); */
+			/* ll__list_find(list, &key, &head, &prev, &curr, &next); */
 			ll_hp_clear(list->hp);
 		}
-		return true;
+		return LL_LIST_SUCCESS;
+	}
+}
+
+/*
+ * The combiner runs the same lock-free insert and delete, so the operations that bypass it (contains, and the try_
+ * variants with their own retry budget) need not care whether the combining is on.
+ */
+enum {
+	LL__FC_INSERT,
+	LL__FC_DELETE,
+};
+
+static uintptr_t
+ll__list_apply(void *ctx, unsigned int op, uintptr_t key) {
+	ll_list_t *list = (ll_list_t *)ctx;
+	ll__budget_t budget = { .max = 0 };
+
+	switch (op) {
+	case LL__FC_INSERT:
+		return (ll__list_insert(list, key, &budget) == LL_LIST_SUCCESS);
+	case LL__FC_DELETE:
+		return (ll__list_delete(list, key, &budget) == LL_LIST_SUCCESS);
+	default:
+		assert(0);
+		return (false);
+	}
+}
+
+static bool
+ll__list_op(ll_list_t *list, unsigned int op, ll_key_t key) {
+	if (ll_fc_combining(list->fc)) {
+		return (ll_fc_execute(list->fc, op, key) != 0);
+	}
+	return (ll__list_apply(list, op, key) != 0);
+}
+
+/*
+ * Link the nodes of the sorted 'keys' privately behind the head of an empty list and publish the whole chain with a
+ * single store.  Nobody may insert to the list meanwhile, the chain would replace whatever was linked after the head.
+ */
+static void
+ll__list_link_sorted(ll_list_t *list, const ll_key_t *keys, size_t n) {
+	ll_node_t *head = (ll_node_t *)atomic_load_explicit(&list->head, LL__RELAXED);
+	ll_node_t *tail = (ll_node_t *)atomic_load_explicit(&head->next, LL__RELAXED);
+	ll_node_t *first = tail;
+
+	assert(tail->key == UINTPTR_MAX);
+	ll_node_t *last = NULL;
+
+	for (size_t i = 0; i < n; i++) {
+		assert(keys[i] > ((i > 0) ? keys[i - 1] : 0) && keys[i] != UINTPTR_MAX);
+		ll_node_t *node = ll_node_new(list, keys[i]);
+		if (last == NULL) {
+			first = node;
+		} else {
+			atomic_store_explicit(&last->next, (uintptr_t)node, LL__RELAXED);
+		}
+		last = node;
+	}
+	if (last != NULL) {
+		atomic_store_explicit(&last->next, (uintptr_t)tail, LL__RELAXED);
 	}
+
+	/* Release: whoever reads the link to the first node sees the whole chain */
+	atomic_store_explicit(&head->next, (uintptr_t)first, LL__RELEASE);
+}
+
+/*
+ * The snapshot file is the header followed by the keys in ascending order, in the byte order and size of the machine
+ * that wrote them.
+ */
+#define LL__SNAPSHOT_MAGIC 0x4c4c4b31 /* "LLK1" */
+#define LL__SNAPSHOT_CHUNK 4096	      /* keys buffered per write(2) */
+
+typedef struct ll__snapshot_header {
+	uint32_t magic;
+	uint32_t keysize;
+} ll__snapshot_header_t;
+
+static int
+ll__write_all(int fd, const void *buf, size_t len) {
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t r = write(fd, p, len);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (-1);
+		}
+		p += r;
+		len -= (size_t)r;
+	}
+	return (0);
+}
+
+/* PUBLIC */
+
+bool
+ll_list_insert(ll_list_t *list, ll_key_t key) {
+	return (ll__list_op(list, LL__FC_INSERT, key));
+}
+
+bool
+ll_list_delete(ll_list_t *list, ll_key_t key) {
+	return (ll__list_op(list, LL__FC_DELETE, key));
+}
+
+ll_list_result_t
+ll_list_try_insert(ll_list_t *list, ll_key_t key, size_t max_attempts, size_t *attemptsp) {
+	assert(max_attempts > 0);
+	ll__budget_t budget = { .max = max_attempts };
+	ll_list_result_t result = ll__list_insert(list, key, &budget);
+	if (attemptsp != NULL) {
+		*attemptsp = (budget.attempts > max_attempts) ? max_attempts : budget.attempts;
+	}
+	return result;
+}
+
+ll_list_result_t
+ll_list_try_delete(ll_list_t *list, ll_key_t key, size_t max_attempts, size_t *attemptsp) {
+	assert(max_attempts > 0);
+	ll__budget_t budget = { .max = max_attempts };
+	ll_list_result_t result = ll__list_delete(list, key, &budget);
+	if (attemptsp != NULL) {
+		*attemptsp = (budget.attempts > max_attempts) ? max_attempts : budget.attempts;
+	}
+	return result;
 }
 
 bool
 ll_list_contains(ll_list_t *list, ll_key_t key) {
-	ll_node_t *curr, *next;
+	ll_node_t *head, *curr, *next;
 	atomic_uintptr_t *prev;
-	bool result = ll__list_find(list, &key, &prev, &curr, &next);
+	bool result;
+
+	if (list->bloom != NULL && !ll_bloom_test(list->bloom, key)) {
+		return false;
+	}
+
+	ll__budget_t budget = { .max = 0 };
+	do {
+		result = ll__list_find(list, &key, &head, &prev, &curr, &next, &budget);
+	} while (ll__list_moved(list, head));
 	ll_hp_clear(list->hp);
 	return result;
 }
 
-ll_list_t *
-ll_list_new(void) {
-	ll_list_t *list = calloc(1, sizeof(*list));
-	ll_node_t *head = ll_node_new(0);
-	ll_node_t *tail = ll_node_new(UINTPTR_MAX);
-	ll_hp_t *hp = ll_hp_new(3, ll__list_node_delete);
+void
+ll_list_iter_init(ll_list_t *list, ll_list_iter_t *iter) {
+	*iter = (ll_list_iter_t){ .list = list, .key = 0, .head = NULL, .node = NULL };
+}
 
-	assert(list != NULL);
-	assert(head != NULL);
-	assert(tail != NULL);
-	atomic_init(&head->next, (uintptr_t)tail);
-	*list = (ll_list_t){
-		.hp = hp
-	};
-	atomic_init(&list->head, (uintptr_t)head);
-	atomic_init(&list->tail, (uintptr_t)tail);
+bool
+ll_list_iter_next(ll_list_iter_t *iter, ll_key_t *keyp) {
+	ll_list_t *list = iter->list;
+	ll_node_t *curr = iter->node;
+	unsigned int backoff = 0;
 
-	return list;
+	while (true) {
+		if (curr == NULL) {
+			/* (Re)start after the last key returned, this also unlinks the deleted nodes on the way */
+			ll_key_t key = iter->key + 1;
+			ll__budget_t budget = { .max = 0 };
+			atomic_uintptr_t *prev;
+			ll_node_t *next;
+			(void)ll__list_find(list, &key, &iter->head, &prev, &curr, &next, &budget);
+		} else {
+			/* 'curr' is protected by HP_CURR since the previous call */
+			ll_node_t *next = (ll_node_t *)ll__list_load(&curr->next, LL__RELAXED);
+			(void)ll_hp_protect_ptr(list->hp, HP_NEXT, get_unmarked(next));
+			if (ll__list_load(&curr->next, LL__SEQ_CST) != (uintptr_t)next) {
+				ll_cm_backoff(list->cm, &backoff);
+				continue;
+			}
+			if (is_marked(next)) {
+				/* 'curr' is deleted, its successor may be gone already and is not safe to follow */
+				curr = NULL;
+				continue;
+			}
+			curr = next;
+			(void)ll_hp_protect_release(list->hp, HP_CURR, (uintptr_t)curr);
+			if (is_marked(ll__list_load(&curr->next, LL__RELAXED))) {
+				/* Deleted meanwhile, skip it */
+				continue;
+			}
+		}
+
+		if (ll__list_moved(list, iter->head)) {
+			/* The list has been cleared, go on with the keys inserted since */
+			curr = NULL;
+			continue;
+		}
+		if (curr->key == UINTPTR_MAX) {
+			iter->node = NULL;
+			ll_hp_clear(list->hp);
+			return (false);
+		}
+		iter->key = curr->key;
+		iter->node = curr;
+		*keyp = curr->key;
+		return (true);
+	}
 }
 
 void
-ll_list_destroy(ll_list_t *list) {
-	assert(list != NULL);
-	ll_node_t *prev = (ll_node_t *)atomic_load(&list->head);
-	ll_node_t *node = (ll_node_t *)atomic_load(&prev->next);
-	while (node != NULL) {
-		ll_node_destroy(prev);
-		prev = node;
-		node = (ll_node_t *)atomic_load(&prev->next);
+ll_list_iter_done(ll_list_iter_t *iter) {
+	iter->node = NULL;
+	ll_hp_clear(iter->list->hp);
+}
+
+int
+ll_list_snapshot(ll_list_t *list, int fd) {
+	ll__snapshot_header_t header = { .magic = LL__SNAPSHOT_MAGIC, .keysize = sizeof(ll_key_t) };
+	ll_key_t *buf = malloc(LL__SNAPSHOT_CHUNK * sizeof(*buf));
+	ll_list_iter_t iter;
+	ll_key_t key;
+	size_t n = 0;
+	int r = -1;
+
+	if (buf == NULL) {
+		return (-1);
 	}
-	ll_node_destroy(prev);
-	ll_hp_destroy(list->hp);
-	free(list);
+	if (ll__write_all(fd, &header, sizeof(header)) != 0) {
+		goto out;
+	}
+
+	ll_list_iter_init(list, &iter);
+	while (ll_list_iter_next(&iter, &key)) {
+		buf[n++] = key;
+		if (n == LL__SNAPSHOT_CHUNK) {
+			if (ll__write_all(fd, buf, n * sizeof(*buf)) != 0) {
+				ll_list_iter_done(&iter);
+				goto out;
+			}
+			n = 0;
+		}
+	}
+	r = ll__write_all(fd, buf, n * sizeof(*buf));
+
+out:
+	free(buf);
+	return (r);
 }
 
-static uintptr_t elements[MAX_THREADS + 1][NELEMENTS];
+ll_list_t *
+ll_list_load(int fd) {
+	struct stat st;
 
-#define TID_UNKNOWN -1
+	if (fstat(fd, &st) != 0) {
+		return (NULL);
+	}
+	if (st.st_size < (off_t)sizeof(ll__snapshot_header_t) ||
+	    (st.st_size - sizeof(ll__snapshot_header_t)) % sizeof(ll_key_t) != 0) {
+		errno = EINVAL;
+		return (NULL);
+	}
 
-static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+	size_t size = (size_t)st.st_size;
+	char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return (NULL);
+	}
+	(void)madvise(map, size, MADV_SEQUENTIAL);
 
-static thread_local int tid_v = TID_UNKNOWN;
+	const ll__snapshot_header_t *header = (const ll__snapshot_header_t *)map;
+	const ll_key_t *keys = (const ll_key_t *)(map + sizeof(*header));
+	size_t n = (size - sizeof(*header)) / sizeof(ll_key_t);
 
-static inline int
-tid(void) {
-	if (tid_v == TID_UNKNOWN) {
-		tid_v = atomic_fetch_add(&tid_v_base, 1);
-		assert(tid_v < MAX_THREADS);
+	/* The keys are linked blindly, so they must be what ll_list_snapshot() wrote */
+	bool valid = (header->magic == LL__SNAPSHOT_MAGIC && header->keysize == sizeof(ll_key_t));
+	for (size_t i = 0; valid && i < n; i++) {
+		valid = (keys[i] > ((i > 0) ? keys[i - 1] : 0) && keys[i] != UINTPTR_MAX);
+	}
+	if (!valid) {
+		(void)munmap(map, size);
+		errno = EINVAL;
+		return (NULL);
 	}
 
-	return (tid_v);
+	ll_list_t *list = ll_list_from_sorted(keys, n);
+	(void)munmap(map, size);
+
+	return (list);
 }
 
-static void *
-insert_thread(void *arg) {
-	ll_list_t *list = (ll_list_t *)arg;
+bool
+ll_list_move(ll_list_t *src, ll_list_t *dst, ll_key_t key) {
+	ll_node_t *shead, *scurr, *snext, *dhead, *dcurr, *dnext;
+	atomic_uintptr_t *sprev, *dprev;
+	ll__budget_t budget = { .max = 0 };
+	unsigned int backoff = 0;
+	bool moved = false;
+
+	if (src == dst) {
+		return (ll_list_contains(src, key));
+	}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		(void)ll_list_insert(list, (uintptr_t)&elements[tid()][i]);
+	ll_node_t *node = ll_node_new(dst, key);
+	if (dst->bloom != NULL) {
+		ll_bloom_add(dst->bloom, key);
 	}
-	return NULL;
-}
 
-static void *
-delete_thread(void *arg) {
-	ll_list_t *list = (ll_list_t *)arg;
+	while (true) {
+		bool found = ll__list_find(src, &key, &shead, &sprev, &scurr, &snext, &budget);
+		if (!found) {
+			if (ll__list_moved(src, shead)) {
+				continue;
+			}
+			break;
+		}
+		if (ll__list_find(dst, &key, &dhead, &dprev, &dcurr, &dnext, &budget)) {
+			if (ll__list_moved(dst, dhead)) {
+				continue;
+			}
+			break;
+		}
+
+		/*
+		 * Mark the node in the source and link the new one to the destination at once, as long as neither list
+		 * has been cleared.  The node is private until then.  The heads are only compared, so the moves do not
+		 * queue up on them, and HP_HEAD keeps a head that has been swapped out from coming back.
+		 */
+		atomic_store_explicit(&node->next, (uintptr_t)dcurr, LL__RELAXED);
+		atomic_uintptr_t *const addrs[] = { &src->head, &dst->head, &scurr->next, dprev };
+		const uintptr_t olds[] = { (uintptr_t)shead, (uintptr_t)dhead, (uintptr_t)snext, (uintptr_t)dcurr };
+		const uintptr_t news[] = { (uintptr_t)shead, (uintptr_t)dhead, get_marked(snext), (uintptr_t)node };
+		if (ll_mwcas(4, addrs, olds, news)) {
+			moved = true;
+			break;
+		}
+		ll_cm_backoff(dst->cm, &backoff);
+	}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		(void)ll_list_delete(list, (uintptr_t)&elements[tid()][i]);
+	if (moved) {
+		if (src->bloom != NULL) {
+			ll_bloom_remove(src->bloom, key);
+		}
+		/* Unlink the marked node from the source */
+		(void)ll__list_find(src, &key, &shead, &sprev, &scurr, &snext, &budget);
+	} else {
+		if (dst->bloom != NULL) {
+			ll_bloom_remove(dst->bloom, key);
+		}
+		ll_node_destroy(node);
 	}
-	return NULL;
+	ll_hp_clear(src->hp);
+	ll_hp_clear(dst->hp);
+
+	return (moved);
 }
 
-int
-main(void) {
-	ll_list_t *list = ll_list_new();
+ll_cm_t *
+ll_list_cm(ll_list_t *list) {
+	return (list->cm);
+}
 
-	/* insert_thread(list); */
+ll_fc_t *
+ll_list_fc(ll_list_t *list) {
+	return (list->fc);
+}
 
-	size_t nthreads = NTHREADS;
-	if (nthreads > 0) {
-		pthread_t threads[nthreads];
+ll_list_t *
+ll_list_new_bloom(size_t capacity) {
+	ll_list_t *list = ll_list_new();
+	list->bloom = ll_bloom_new(capacity);
+	return list;
+}
 
-		assert(nthreads / 2 >= 1);
-		assert(nthreads % 2 == 0);
+static ll_list_t *
+ll__list_new(ll_pool_t *pool) {
+	ll_list_t *list = calloc(1, sizeof(*list));
+	assert(list != NULL);
 
-		for (size_t i = 0; i < nthreads; i++) {
-			switch (i % 2) {
-			case 0: pthread_create(&threads[i], NULL, insert_thread, list); break;
-			case 1: pthread_create(&threads[i], NULL, delete_thread, list); break;
-			default: assert(0);
-			}
-		}
+	*list = (ll_list_t){
+		.hp = ll_hp_new(4, ll__list_node_delete),
+		.cm = ll_cm_new(LL_CM_BACKOFF, 0, 0),
+		.pool = pool,
+	};
 
-		for (size_t i = 0; i < nthreads; i++) {
-			pthread_join(threads[i], NULL);
-		}
+	ll_node_t *head = ll_node_new(list, 0);
+	ll_node_t *tail = ll_node_new(list, UINTPTR_MAX);
+	atomic_init(&head->next, (uintptr_t)tail);
+	list->fc = ll_fc_new(ll__list_apply, list, list->cm, LL_FC_OFF);
+	atomic_init(&list->head, (uintptr_t)head);
 
-		/* for (size_t i = 0; i < nthreads; i++) { */
-		/* 	pthread_create(&threads[i], NULL, insert_thread, list); */
-		/* } */
+	return list;
+}
 
-		/* for (size_t i = 0; i < nthreads; i++) { */
-		/* 	pthread_join(threads[i], NULL); */
-		/* } */
+ll_list_t *
+ll_list_new(void) {
+	return (ll__list_new(ll_pool_new(sizeof(ll_node_t), alignof(ll_node_t), offsetof(ll_node_t, key), 0)));
+}
 
-		/* for (size_t i = 0; i < nthreads; i++) { */
-		/* 	pthread_create(&threads[i], NULL, delete_thread, list); */
-		/* } */
+ll_list_t *
+ll_list_new_arena(void) {
+	return (ll__list_new(ll_pool_new_arena(sizeof(ll_node_t), alignof(ll_node_t), offsetof(ll_node_t, key))));
+}
 
-		/* for (size_t i = 0; i < nthreads; i++) { */
-		/* 	pthread_join(threads[i], NULL); */
-		/* } */
-	}
+ll_list_t *
+ll_list_from_sorted(const ll_key_t *keys, size_t n) {
+	ll_list_t *list = ll_list_new();
+	ll__list_link_sorted(list, keys, n);
+	return (list);
+}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		for (size_t j = 0; j < tid_v_base; j++) {
-			ll_list_delete(list, (uintptr_t)&elements[j][i]);
+/*
+ * Take the keys of a chain swapped out by ll_list_clear() out of the filter.  Every node is marked the way a delete
+ * marks it, and the key leaves the filter only if the mark was ours, so a key deleted concurrently is not removed
+ * twice.  A marked link never changes again, so the nodes reached through it stay in the chain until the chain itself
+ * is retired; the head sentinel is marked too, nothing can be unlinked from the chain anymore.
+ */
+static void
+ll__list_unfilter(ll_list_t *list, ll_node_t *node) {
+	while (node->key != UINTPTR_MAX) {
+		uintptr_t next = ll__list_load(&node->next, LL__SEQ_CST);
+		if (!is_marked(next)) {
+			if (!atomic_compare_exchange_strong_explicit(&node->next, &next, get_marked(next), LL__RELAXED,
+								     LL__RELAXED)) {
+				ll__list_resolve(&node->next, next);
+				continue;
+			}
+			if (node->key != 0) {
+				ll_bloom_remove(list->bloom, node->key);
+			}
 		}
+		node = get_unmarked_node(next);
 	}
+}
 
-	ll_list_destroy(list);
-
-	fprintf(stderr, "inserts = %zu, deletes = %zu\n", atomic_load(&inserts), atomic_load(&deletes));
+void
+ll_list_clear(ll_list_t *list) {
+	ll_node_t *head = ll_node_new(list, 0);
+	ll_node_t *tail = ll_node_new(list, UINTPTR_MAX);
+	atomic_store_explicit(&head->next, (uintptr_t)tail, LL__RELAXED);
+
+	/*
+	 * The operations still running on the old chain notice the swap with ll__list_moved() and retry, and their
+	 * HP_HEAD keeps the old chain alive until they are gone.  A move that has found its nodes on the old chain
+	 * compares the head in its multi-word CAS and fails.  The head is never acquired by one, so a plain swap does.
+	 */
+	uintptr_t old = atomic_exchange_explicit(&list->head, (uintptr_t)head, LL__SEQ_CST);
+	if (list->bloom != NULL) {
+		ll__list_unfilter(list, (ll_node_t *)old);
+	}
+	ll_hp_retire(list->hp, old);
+}
 
-	return (0);
+void
+ll_list_destroy(ll_list_t *list) {
+	assert(list != NULL);
+	/* The retired nodes go back to the pool, the pool takes the rest with it */
+	ll_hp_destroy(list->hp);
+	ll_pool_destroy(list->pool);
+	ll_fc_destroy(list->fc);
+	ll_cm_destroy(list->cm);
+	if (list->bloom != NULL) {
+		ll_bloom_destroy(list->bloom);
+	}
+	free(list);
 }
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cm.h"
+#include "fc.h"
+
+/*%
+ * Lock-free doubly linked deque.
+ *
+ * This is the algorithm from Håkan Sundell and Philippas Tsigas: Lock-free
+ * deques and doubly linked lists.  Every deque is self-contained, it
+ * embeds its own head and tail sentinels (each on its own cache line),
+ * its own node pool and its own contention manager, so any number of
+ * deques can be used at the same time.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report an empty deque.
+ */
+
+typedef struct ll_deque ll_deque_t;
+
+enum {
+	LL_DEQUE_HP = 1 << 0,	       /*%< Reclaim the nodes with hazard pointers */
+	LL_DEQUE_ELIMINATION = 1 << 1, /*%< Pair colliding pushes and pops */
+	LL_DEQUE_COMBINING = 1 << 2,   /*%< Flat combining under contention */
+	LL_DEQUE_LEAK = 1 << 3,	       /*%< Never reclaim the nodes, a baseline */
+	LL_DEQUE_ARENA = 1 << 4,       /*%< Take the nodes from huge page NUMA arenas */
+};
+
+ll_deque_t *
+ll_deque_new(unsigned int flags);
+/*%<
+ * Create a new empty deque.  By default the nodes are reclaimed with
+ * Valois, Michael and Scott reference counting; LL_DEQUE_HP selects
+ * hazard pointers for the local references instead.  LL_DEQUE_LEAK
+ * never reclaims the nodes at all, the memory grows with every pop
+ * until the deque is destroyed; it is there to measure what the other
+ * two schemes cost.
+ *
+ * With LL_DEQUE_ARENA the nodes come from ll_pool_new_arena() (see
+ * pool.h): huge page backed slabs, one set per NUMA node.
+ *
+ * With LL_DEQUE_ELIMINATION every end of the deque gets an elimination
+ * array, after Danny Hendler, Nir Shavit and Lena Yerushalmi: A Scalable
+ * Lock-free Stack Algorithm.  A push whose CAS on the sentinel link has
+ * failed offers its value in a random slot for a short while, and a pop
+ * whose CAS has failed at the same end takes the value from there; the
+ * pair is linearized as the push immediately followed by the pop, and
+ * neither of them touches the deque.  The batch operations do not take
+ * part in the elimination.
+ *
+ * LL_DEQUE_COMBINING starts the flat combiner of the deque (see fc.h) in
+ * the adaptive mode: the single pushes and pops are handed over to one
+ * combining thread while the failed CAS rate is high.  The combiner can
+ * be switched later with ll_fc_set_mode(ll_deque_fc(deque), ...).  The
+ * operations that go through the combiner are blocking rather than
+ * lock-free.
+ */
+
+void
+ll_deque_destroy(ll_deque_t *deque);
+/*%<
+ * Destroy the deque.  No other thread may be using it.  The values still
+ * stored in the deque are not touched.
+ */
+
+void
+ll_deque_push_left(ll_deque_t *deque, void *value);
+/*%<
+ * Insert 'value' at the left end of the deque.  'value' must not be NULL.
+ * Wakes up a consumer sleeping in one of the _wait functions, which costs
+ * a single load when there is none.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_deque_push_right(ll_deque_t *deque, void *value);
+/*%<
+ * Insert 'value' at the right end of the deque.  'value' must not be NULL.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_deque_pop_left(ll_deque_t *deque);
+/*%<
+ * Remove and return the value at the left end of the deque, or NULL if
+ * the deque is empty.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_deque_pop_right(ll_deque_t *deque);
+/*%<
+ * Remove and return the value at the right end of the deque, or NULL if
+ * the deque is empty.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_deque_peek_left(ll_deque_t *deque);
+/*%<
+ * Return the value at the left end of the deque without removing it, or
+ * NULL if the deque is empty.  The value may be popped by another thread
+ * as soon as it is returned, so it is only a hint; the caller must keep
+ * the memory it points to valid if it looks into it.  A value waiting in
+ * the elimination array is not seen.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_deque_push_left_batch(ll_deque_t *deque, void **values, size_t n);
+/*%<
+ * Insert the 'n' values at the left end of the deque, in the same order
+ * as 'n' calls to ll_deque_push_left() would.  The nodes are linked to
+ * each other privately and spliced in with a single CAS.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_deque_push_right_batch(ll_deque_t *deque, void **values, size_t n);
+/*%<
+ * Insert the 'n' values at the right end of the deque, in the same order
+ * as 'n' calls to ll_deque_push_right() would.
+ *
+ * Progress condition: lock-free.
+ */
+
+size_t
+ll_deque_pop_left_batch(ll_deque_t *deque, void **values, size_t n);
+/*%<
+ * Remove up to 'n' values from the left end of the deque, store them to
+ * 'values' from left to right and return their number.  The values are
+ * taken as one run, which is unlinked from the deque at once, however
+ * long it is.  Only the unlinking is shared by the run: every value is
+ * still claimed with a CAS of its own and has its node deleted like a
+ * single pop does, the batch saves the unlinking, not the claims.  The
+ * run stops early when a concurrent pop gets to a value
+ * first; fewer than 'n' values are returned only when the deque ran
+ * empty or the batch lost such a race.
+ *
+ * The batch as a whole is not atomic, and the values need not have been
+ * the leftmost ones at any single instant: a value pushed to the left
+ * end once the first value has been claimed is not taken by the batch,
+ * it stays in front of the run.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_deque_pop_left_wait(ll_deque_t *deque, long timeout_ns);
+/*%<
+ * Same as ll_deque_pop_left(), but wait until a value arrives when the
+ * deque is empty.  The caller spins for a short while, then sleeps on a
+ * futex until a push wakes it up.  Waits forever if 'timeout_ns' is
+ * negative; returns NULL if nothing arrived within 'timeout_ns'
+ * nanoseconds.
+ *
+ * Progress condition: blocking.
+ */
+
+void *
+ll_deque_pop_right_wait(ll_deque_t *deque, long timeout_ns);
+/*%<
+ * Same as ll_deque_pop_left_wait(), at the right end of the deque.
+ *
+ * Progress condition: blocking.
+ */
+
+ll_cm_t *
+ll_deque_cm(ll_deque_t *deque);
+/*%<
+ * Return the contention manager of the deque, it can be used to change
+ * the strategy or to read the number of failed attempts.
+ */
+
+size_t
+ll_deque_unreclaimed(ll_deque_t *deque);
+/*%<
+ * Return the number of nodes that have been taken out of the deque but
+ * not yet reclaimed, the memory the reclamation scheme holds back.  The
+ * value is only a hint while the deque is being modified.
+ */
+
+ll_fc_t *
+ll_deque_fc(ll_deque_t *deque);
+/*%<
+ * Return the flat combiner of the deque, it can be used to change the
+ * combining mode.
+ */
+
+bool
+ll_deque_tracing(void);
+/*%<
+ * Return whether the deque has been built with LL_DEQUE_TRACE, which
+ * writes every node operation to stderr.  Nothing measured on such a
+ * build means anything.
+ */
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cm.h"
+#include "fc.h"
+
+/*%
+ * Lock-free sorted singly linked list, used as a set of keys.
+ *
+ * This is the algorithm from Maged M. Michael: High Performance Dynamic
+ * Lock-Free Hash Tables and List-Based Sets, with the nodes reclaimed
+ * with hazard pointers.  A key is deleted by marking the link to its
+ * successor first and unlinking the node afterwards, so a traversal
+ * never follows a link out of a deleted node.
+ *
+ * The keys 0 and UINTPTR_MAX are taken by the head and tail sentinels.
+ */
+
+typedef uintptr_t ll_key_t;
+typedef struct ll_list ll_list_t;
+
+typedef enum ll_list_result {
+	LL_LIST_SUCCESS,   /*%< the key was inserted or deleted */
+	LL_LIST_FAILURE,   /*%< the key was already present or not found */
+	LL_LIST_CONTENDED, /*%< the retry budget ran out, nothing was changed */
+} ll_list_result_t;
+
+/*%
+ * Iterator over the keys of a list, see ll_list_iter_init().
+ */
+typedef struct ll_list_iter {
+	ll_list_t *list;
+	ll_key_t key;	      /*%< the last key returned */
+	struct ll_node *head; /*%< the chain walked, see ll_list_clear() */
+	struct ll_node *node; /*%< the node of 'key', protected by a hazard pointer */
+} ll_list_iter_t;
+
+ll_list_t *
+ll_list_new(void);
+/*%<
+ * Create a new empty list.
+ */
+
+ll_list_t *
+ll_list_new_bloom(size_t capacity);
+/*%<
+ * Create a new empty list with a Bloom filter (see bloom.h) sized for
+ * 'capacity' keys in front of it, so that ll_list_contains() answers the
+ * lookups of most absent keys without walking the list.
+ */
+
+ll_list_t *
+ll_list_new_arena(void);
+/*%<
+ * Create a new empty list whose nodes come from huge page backed NUMA
+ * arenas, see ll_pool_new_arena() in pool.h.
+ */
+
+ll_list_t *
+ll_list_from_sorted(const ll_key_t *keys, size_t n);
+/*%<
+ * Create a new list of the 'n' 'keys', which must be strictly ascending.
+ * The nodes are linked privately and published with a single store,
+ * which takes O(n) time instead of the O(n^2) of 'n' inserts.
+ */
+
+void
+ll_list_clear(ll_list_t *list);
+/*%<
+ * Remove all the keys from the list at once.  A fresh empty chain is
+ * swapped in with a single atomic exchange of the head and the old
+ * chain is retired as a whole with the hazard pointers; the operations
+ * still running on the old chain retry on the new one, so every
+ * operation takes effect either before or after the clear.  An
+ * ll_list_move() compares the heads of both lists in its multi-word CAS,
+ * so one that raced with the clear fails and retries.
+ *
+ * With a Bloom filter the clear then walks the old chain and takes its
+ * keys out of the filter, marking the nodes the way a delete would, so
+ * that the filter does not fill up with the cleared keys.  The list is
+ * empty from the swap on, but the clear itself takes time linear in the
+ * number of the cleared keys.
+ *
+ * Progress condition: wait-free without a Bloom filter, lock-free with
+ * one.
+ */
+
+void
+ll_list_destroy(ll_list_t *list);
+/*%<
+ * Destroy the list.  No other thread may be using it.
+ */
+
+bool
+ll_list_insert(ll_list_t *list, ll_key_t key);
+/*%<
+ * Insert 'key' to the list.  Return false if it was already there.
+ *
+ * Progress condition: lock-free.
+ */
+
+bool
+ll_list_delete(ll_list_t *list, ll_key_t key);
+/*%<
+ * Delete 'key' from the list.  Return false if it was not there.
+ *
+ * Progress condition: lock-free.
+ */
+
+bool
+ll_list_contains(ll_list_t *list, ll_key_t key);
+/*%<
+ * Return whether 'key' is in the list.
+ *
+ * Progress condition: lock-free.
+ */
+
+bool
+ll_list_move(ll_list_t *src, ll_list_t *dst, ll_key_t key);
+/*%<
+ * Move 'key' from 'src' to 'dst' atomically: the node of the key in
+ * 'src' is marked and a new node is linked to 'dst' with a single
+ * multi-word CAS (see mwcas.h), so no thread ever finds the key in both
+ * lists or in neither.  Return false, and change nothing, if the key is
+ * not in 'src' or already in 'dst'.  The readers of both lists look
+ * through a move in progress, and an insert or a delete that needs one
+ * of its links helps it to its end first.  The heads of the lists are
+ * only compared, so moves of different keys do not get in each other's
+ * way.
+ *
+ * Progress condition: lock-free.
+ */
+
+ll_list_result_t
+ll_list_try_insert(ll_list_t *list, ll_key_t key, size_t max_attempts, size_t *attemptsp);
+/*%<
+ * Same as ll_list_insert(), but give up with LL_LIST_CONTENDED after
+ * 'max_attempts' traversals of the list.  The number of attempts spent
+ * is stored to 'attemptsp' unless it is NULL.
+ *
+ * Progress condition: lock-free.
+ */
+
+ll_list_result_t
+ll_list_try_delete(ll_list_t *list, ll_key_t key, size_t max_attempts, size_t *attemptsp);
+/*%<
+ * Same as ll_list_try_insert(), for ll_list_delete().
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_list_iter_init(ll_list_t *list, ll_list_iter_t *iter);
+/*%<
+ * Start iterating over the keys of the list in ascending order.  The
+ * iterator holds the hazard pointers of the calling thread, so the
+ * thread must not use the list otherwise until the iteration is over.
+ *
+ * The iteration is weakly consistent: every key returned was in the list
+ * at some point during the iteration, every key that stays in the list
+ * during the whole iteration is returned, and the keys are returned in
+ * ascending order, at most once each.
+ */
+
+bool
+ll_list_iter_next(ll_list_iter_t *iter, ll_key_t *keyp);
+/*%<
+ * Store the next key to 'keyp' and return true, or return false at the
+ * end of the list, which also finishes the iteration.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_list_iter_done(ll_list_iter_t *iter);
+/*%<
+ * Finish the iteration before ll_list_iter_next() has returned false.
+ */
+
+int
+ll_list_snapshot(ll_list_t *list, int fd);
+/*%<
+ * Write the keys of the list to 'fd' in ascending order, with the
+ * iterator above; the snapshot is as consistent as the iteration, it
+ * may be taken while other threads are using the list.  The keys are
+ * written in the byte order of the machine.
+ *
+ * Return 0 on success, or -1 with errno set if write(2) failed.
+ *
+ * Progress condition: lock-free.
+ */
+
+ll_list_t *
+ll_list_load(int fd);
+/*%<
+ * Create a new list from a file written by ll_list_snapshot(), which
+ * must start at offset 0 and contain nothing else.  The file is mapped
+ * and the nodes are linked in a single pass, no key is inserted one by
+ * one.
+ *
+ * Return NULL with errno set if the file could not be mapped, or to
+ * EINVAL if it is not a valid snapshot.
+ */
+
+ll_cm_t *
+ll_list_cm(ll_list_t *list);
+/*%<
+ * Return the contention manager of the list, it can be used to change
+ * the strategy or to read the number of failed attempts.
+ */
+
+ll_fc_t *
+ll_list_fc(ll_list_t *list);
+/*%<
+ * Return the flat combiner of the list, it can be used to change the
+ * combining mode (off by default).
+ */
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "cm.h"
+#include "hp.h"
+#include "ll_deque.h"
+#include "lru.h"
+#include "pool.h"
+#include "tid.h"
+
+#define LRU_READ_BUFFER 32 /* hits recorded by a thread before they are applied */
+
+#define HP_NEXT 0
+#define HP_CURR 1
+#define HP_PREV 2
+
+#define is_marked(p)	(bool)((uintptr_t)(p)&0x01)
+#define get_marked(p)	((uintptr_t)(p) | (0x01))
+#define get_unmarked(p) ((uintptr_t)(p) & (~0x01))
+
+#define get_unmarked_entry(p) ((lru_entry_t *)get_unmarked(p))
+
+/*
+ * The state of an entry is its version in the upper half, bumped every time the entry goes back to the pool, the
+ * LINKED bit, set while the hash index owns the entry, and the number of times the entry is in the recency deque.  The
+ * entry is freed when both the bit and the count are gone.
+ */
+#define STATE_LINKED	 ((uint_fast64_t)1 << 31)
+#define STATE_REFS(s)	 ((s) & (STATE_LINKED - 1))
+#define STATE_VERSION(s) ((uint32_t)((s) >> 32))
+
+typedef struct lru_entry {
+	atomic_uintptr_t next; /* in the bucket, marked when the entry is deleted */
+	uintptr_t key;
+	atomic_uintptr_t value;	    /* the pool link while the entry is free */
+	atomic_uint_fast64_t state; /* never overwritten by the pool, see lru_drain() */
+	struct ll_lru *lru;
+} lru_entry_t;
+
+/* A hit waiting in a read buffer; the entry may have been freed and reused meanwhile */
+typedef struct lru_access {
+	lru_entry_t *entry;
+	uint32_t version;
+} lru_access_t;
+
+/* The read buffer is used by its owner only, keep them apart */
+typedef struct lru_buffer {
+	alignas(128) size_t n;
+	lru_access_t accesses[LRU_READ_BUFFER];
+} lru_buffer_t;
+
+struct ll_lru {
+	size_t capacity;
+	unsigned int shift; /* 64 - log2 of the number of buckets */
+	atomic_uintptr_t *buckets;
+	ll_hp_t *hp;
+	ll_cm_t *cm;
+	ll_pool_t *pool;
+	ll_deque_t *recency; /* least recently used on the left */
+	alignas(128) atomic_size_t size;
+	alignas(128) atomic_size_t queued; /* entries in the recency deque, counting the repeated ones */
+	lru_buffer_t buffers[LL_TID_MAX];
+};
+
+/* Fibonacci hashing, the upper bits of the product are the best mixed */
+static inline atomic_uintptr_t *
+lru_bucket(ll_lru_t *lru, uintptr_t key) {
+	return (&lru->buckets[((uint64_t)key * UINT64_C(0x9e3779b97f4a7c15)) >> lru->shift]);
+}
+
+static lru_entry_t *
+lru_entry_new(ll_lru_t *lru, uintptr_t key, void *value) {
+	lru_entry_t *entry = ll_pool_get(lru->pool);
+
+	atomic_store_explicit(&entry->next, 0, memory_order_relaxed);
+	entry->key = key;
+	entry->lru = lru;
+	atomic_store_explicit(&entry->value, (uintptr_t)value, memory_order_relaxed);
+	/* The pending push to the recency deque counts already, the entry may be deleted before it */
+	uint_fast64_t state = atomic_load_explicit(&entry->state, memory_order_relaxed);
+	atomic_store_explicit(&entry->state, ((uint_fast64_t)STATE_VERSION(state) << 32) | STATE_LINKED | 1,
+			      memory_order_relaxed);
+
+	return (entry);
+}
+
+static void
+lru_entry_free(ll_lru_t *lru, lru_entry_t *entry) {
+	uint_fast64_t state = atomic_load(&entry->state);
+
+	assert(STATE_REFS(state) == 0 && (state & STATE_LINKED) == 0);
+	/* The hits still buffered for the old version will not match */
+	atomic_store(&entry->state, (uint_fast64_t)(STATE_VERSION(state) + 1) << 32);
+	ll_pool_put(lru->pool, entry);
+}
+
+/* The hash index is done with the entry, called by the hazard pointers */
+static void
+lru_entry_unlinked(void *arg) {
+	lru_entry_t *entry = (lru_entry_t *)arg;
+	uint_fast64_t state = atomic_fetch_and(&entry->state, ~STATE_LINKED);
+
+	if (STATE_REFS(state) == 0) {
+		lru_entry_free(entry->lru, entry);
+	}
+}
+
+/* A position of the entry has been popped from the recency deque and dropped, leaving 'state' */
+static void
+lru_entry_unqueued(ll_lru_t *lru, lru_entry_t *entry, uint_fast64_t state) {
+	(void)atomic_fetch_sub(&lru->queued, 1);
+	if (STATE_REFS(state) == 0 && (state & STATE_LINKED) == 0) {
+		lru_entry_free(lru, entry);
+	}
+}
+
+/*
+ * Find the first entry of the bucket with a key not lower than 'key', unlinking the deleted entries on the way.  The
+ * entry and its neighbours stay protected by the hazard pointers.
+ */
+static bool
+lru_find(ll_lru_t *lru, atomic_uintptr_t *bucket, uintptr_t key, atomic_uintptr_t **prevp, lru_entry_t **currp,
+	 lru_entry_t **nextp) {
+	atomic_uintptr_t *prev;
+	lru_entry_t *curr, *next;
+	unsigned int backoff = 0;
+
+try_again:
+	prev = bucket;
+	curr = (lru_entry_t *)ll_hp_protect(lru->hp, HP_CURR, prev);
+	while (curr != NULL) {
+		next = (lru_entry_t *)atomic_load(&curr->next);
+		(void)ll_hp_protect_ptr(lru->hp, HP_NEXT, get_unmarked(next));
+		if (atomic_load(&curr->next) != (uintptr_t)next || atomic_load(prev) != (uintptr_t)curr) {
+			ll_cm_backoff(lru->cm, &backoff);
+			goto try_again;
+		}
+		if (!is_marked(next)) {
+			if (curr->key >= key) {
+				*prevp = prev;
+				*currp = curr;
+				*nextp = next;
+				return (curr->key == key);
+			}
+			prev = &curr->next;
+			(void)ll_hp_protect_release(lru->hp, HP_PREV, (uintptr_t)curr);
+		} else {
+			uintptr_t tmp = (uintptr_t)curr;
+			if (!atomic_compare_exchange_strong(prev, &tmp, get_unmarked(next))) {
+				ll_cm_backoff(lru->cm, &backoff);
+				goto try_again;
+			}
+			ll_hp_retire(lru->hp, (uintptr_t)curr);
+		}
+		curr = get_unmarked_entry(next);
+		(void)ll_hp_protect_release(lru->hp, HP_CURR, (uintptr_t)curr);
+	}
+
+	*prevp = prev;
+	*currp = NULL;
+	*nextp = NULL;
+	return (false);
+}
+
+/* Delete 'key' from the index, but only if it is cached in 'only' unless that is NULL */
+static bool
+lru_remove(ll_lru_t *lru, uintptr_t key, lru_entry_t *only) {
+	atomic_uintptr_t *bucket = lru_bucket(lru, key);
+	atomic_uintptr_t *prev;
+	lru_entry_t *curr, *next;
+	unsigned int backoff = 0;
+
+	while (true) {
+		if (!lru_find(lru, bucket, key, &prev, &curr, &next) || (only != NULL && curr != only)) {
+			ll_hp_clear(lru->hp);
+			return (false);
+		}
+
+		uintptr_t tmp = (uintptr_t)next;
+		if (!atomic_compare_exchange_strong(&curr->next, &tmp, get_marked(next))) {
+			ll_cm_backoff(lru->cm, &backoff);
+			continue;
+		}
+		(void)atomic_fetch_sub(&lru->size, 1);
+
+		tmp = (uintptr_t)curr;
+		if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t)next)) {
+			ll_hp_clear(lru->hp);
+			ll_hp_retire(lru->hp, (uintptr_t)curr);
+		} else {
+			/* Let the search unlink it */
+			(void)lru_find(lru, bucket, key, &prev, &curr, &next);
+			ll_hp_clear(lru->hp);
+		}
+		return (true);
+	}
+}
+
+/*
+ * Keep the recency deque from growing without bounds when the cache is hit much more often than it is filled: the
+ * stale positions at the front are dropped until the front is the only position of a cached entry.
+ */
+static void
+lru_trim(ll_lru_t *lru) {
+	while (atomic_load(&lru->queued) > 2 * lru->capacity + LRU_READ_BUFFER) {
+		lru_entry_t *entry = ll_deque_pop_left(lru->recency);
+		if (entry == NULL) {
+			return;
+		}
+
+		uint_fast64_t state = atomic_load(&entry->state);
+		do {
+			if (STATE_REFS(state) == 1 && (state & STATE_LINKED) != 0) {
+				/* The least recently used entry, it stays in front */
+				ll_deque_push_left(lru->recency, entry);
+				return;
+			}
+		} while (!atomic_compare_exchange_weak(&entry->state, &state, state - 1));
+		lru_entry_unqueued(lru, entry, state - 1);
+	}
+}
+
+/*
+ * Append the buffered hits to the recency deque.  The entries are not protected anymore, but the pool keeps their
+ * memory, and the version in their state tells whether they are still the entries that were hit.
+ */
+static void
+lru_drain(ll_lru_t *lru, lru_buffer_t *buffer) {
+	for (size_t i = 0; i < buffer->n; i++) {
+		lru_access_t *access = &buffer->accesses[i];
+		uint_fast64_t state = atomic_load(&access->entry->state);
+		bool live = true;
+		do {
+			if (STATE_VERSION(state) != access->version || (state & STATE_LINKED) == 0) {
+				live = false;
+				break;
+			}
+		} while (!atomic_compare_exchange_weak(&access->entry->state, &state, state + 1));
+		if (live) {
+			(void)atomic_fetch_add(&lru->queued, 1);
+			ll_deque_push_right(lru->recency, access->entry);
+		}
+	}
+	buffer->n = 0;
+
+	lru_trim(lru);
+}
+
+/* Record a hit on the protected 'entry', return whether the buffer needs draining */
+static inline bool
+lru_record(ll_lru_t *lru, lru_entry_t *entry) {
+	lru_buffer_t *buffer = &lru->buffers[ll_tid()];
+
+	buffer->accesses[buffer->n++] = (lru_access_t){
+		.entry = entry,
+		.version = STATE_VERSION(atomic_load_explicit(&entry->state, memory_order_relaxed)),
+	};
+	return (buffer->n == LRU_READ_BUFFER);
+}
+
+/*
+ * Evict from the front of the recency deque until the cache fits.  An entry is evicted when its last position in the
+ * deque is popped; the hits that are still buffered may come too late to save it.
+ */
+static void
+lru_evict(ll_lru_t *lru) {
+	while (atomic_load(&lru->size) > lru->capacity) {
+		lru_entry_t *entry = ll_deque_pop_left(lru->recency);
+		if (entry == NULL) {
+			return;
+		}
+
+		uintptr_t key = entry->key;
+		uint_fast64_t state = atomic_fetch_sub(&entry->state, 1) - 1;
+		lru_entry_unqueued(lru, entry, state);
+		if (STATE_REFS(state) == 0 && (state & STATE_LINKED) != 0) {
+			/* Still linked, so not freed yet */
+			(void)lru_remove(lru, key, entry);
+		}
+	}
+}
+
+/* PUBLIC */
+
+ll_lru_t *
+ll_lru_new(size_t capacity) {
+	ll_lru_t *lru = aligned_alloc(alignof(ll_lru_t), sizeof(*lru));
+	assert(lru != NULL);
+	assert(capacity > 0);
+
+	/* At least a bucket per key */
+	unsigned int bits = 0;
+	while (((size_t)1 << bits) < capacity) {
+		bits++;
+	}
+
+	*lru = (ll_lru_t){
+		.capacity = capacity,
+		.shift = 64 - bits,
+		.buckets = calloc((size_t)1 << bits, sizeof(atomic_uintptr_t)),
+		.hp = ll_hp_new(3, lru_entry_unlinked),
+		.cm = ll_cm_new(LL_CM_BACKOFF, 0, 0),
+		.pool = ll_pool_new(sizeof(lru_entry_t), alignof(lru_entry_t), offsetof(lru_entry_t, value), 0),
+		.recency = ll_deque_new(0),
+	};
+	assert(lru->buckets != NULL);
+	atomic_init(&lru->size, 0);
+	atomic_init(&lru->queued, 0);
+
+	return (lru);
+}
+
+void
+ll_lru_destroy(ll_lru_t *lru) {
+	assert(lru != NULL);
+
+	/* The deque holds no references of its own, the pool takes all the entries with it */
+	ll_hp_destroy(lru->hp);
+	ll_deque_destroy(lru->recency);
+	ll_pool_destroy(lru->pool);
+	ll_cm_destroy(lru->cm);
+	free(lru->buckets);
+	free(lru);
+}
+
+void *
+ll_lru_get(ll_lru_t *lru, uintptr_t key) {
+	atomic_uintptr_t *prev;
+	lru_entry_t *curr, *next;
+	void *value = NULL;
+	bool full = false;
+
+	if (lru_find(lru, lru_bucket(lru, key), key, &prev, &curr, &next)) {
+		value = (void *)atomic_load(&curr->value);
+		full = lru_record(lru, curr);
+	}
+	ll_hp_clear(lru->hp);
+
+	if (full) {
+		lru_drain(lru, &lru->buffers[ll_tid()]);
+	}
+	return (value);
+}
+
+bool
+ll_lru_put(ll_lru_t *lru, uintptr_t key, void *value) {
+	atomic_uintptr_t *bucket = lru_bucket(lru, key);
+	atomic_uintptr_t *prev;
+	lru_entry_t *curr, *next;
+	lru_entry_t *entry = NULL;
+	unsigned int backoff = 0;
+
+	assert(value != NULL);
+
+	while (true) {
+		if (lru_find(lru, bucket, key, &prev, &curr, &next)) {
+			atomic_store(&curr->value, (uintptr_t)value);
+			bool full = lru_record(lru, curr);
+			ll_hp_clear(lru->hp);
+			if (entry != NULL) {
+				/* Nobody has seen it, drop the bit and the position it came with */
+				atomic_store(&entry->state, (uint_fast64_t)STATE_VERSION(atomic_load(&entry->state)) << 32);
+				lru_entry_free(lru, entry);
+			}
+			if (full) {
+				lru_drain(lru, &lru->buffers[ll_tid()]);
+			}
+			return (false);
+		}
+
+		if (entry == NULL) {
+			entry = lru_entry_new(lru, key, value);
+		}
+		atomic_store_explicit(&entry->next, (uintptr_t)curr, memory_order_relaxed);
+		uintptr_t tmp = (uintptr_t)curr;
+		if (atomic_compare_exchange_strong(prev, &tmp, (uintptr_t)entry)) {
+			break;
+		}
+		ll_cm_backoff(lru->cm, &backoff);
+	}
+	ll_hp_clear(lru->hp);
+
+	(void)atomic_fetch_add(&lru->queued, 1);
+	ll_deque_push_right(lru->recency, entry);
+	if (atomic_fetch_add(&lru->size, 1) + 1 > lru->capacity) {
+		lru_evict(lru);
+	}
+	return (true);
+}
+
+bool
+ll_lru_delete(ll_lru_t *lru, uintptr_t key) {
+	return (lru_remove(lru, key, NULL));
+}
+
+size_t
+ll_lru_size(ll_lru_t *lru) {
+	return (atomic_load(&lru->size));
+}
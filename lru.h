@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*%
+ * Lock-free cache of a bounded number of keys, evicting the least
+ * recently used ones.
+ *
+ * The keys are indexed in a hash table with a fixed number of buckets,
+ * each bucket a lock-free sorted list after Maged M. Michael: High
+ * Performance Dynamic Lock-Free Hash Tables and List-Based Sets, with the
+ * entries reclaimed with hazard pointers.
+ *
+ * The recency order is kept in a lock-free deque (see ll_deque.h) that
+ * is updated lazily, after the read buffers of Caffeine: a hit only
+ * records the entry in a buffer of the calling thread, and the whole
+ * buffer is appended to the deque when it fills up.  An entry may then
+ * appear in the deque several times; only its last position counts, the
+ * older ones are skipped when they reach the front.  A hit writes to
+ * nothing shared but the hazard pointers of its thread.
+ *
+ * Any thread whose insert makes the cache overflow evicts from the front
+ * of the deque, concurrently with the others.  The eviction is
+ * approximate: the hits still sitting in the read buffers do not count
+ * yet, and the size may exceed the capacity by a few entries for a
+ * while.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report a miss.  The cache never touches them, an evicted value is
+ * simply dropped.
+ */
+
+typedef struct ll_lru ll_lru_t;
+
+ll_lru_t *
+ll_lru_new(size_t capacity);
+/*%<
+ * Create a new empty cache of 'capacity' keys.
+ */
+
+void
+ll_lru_destroy(ll_lru_t *lru);
+/*%<
+ * Destroy the cache.  No other thread may be using it.
+ */
+
+void *
+ll_lru_get(ll_lru_t *lru, uintptr_t key);
+/*%<
+ * Return the value of 'key', or NULL if it is not cached.  A hit makes
+ * the key the most recently used one, eventually.
+ *
+ * Progress condition: lock-free.
+ */
+
+bool
+ll_lru_put(ll_lru_t *lru, uintptr_t key, void *value);
+/*%<
+ * Cache 'value' under 'key', replacing the old value if the key is
+ * already cached.  Return true if the key was new.  'value' must not be
+ * NULL.  If the cache overflows, the least recently used keys are
+ * evicted.
+ *
+ * Progress condition: lock-free.
+ */
+
+bool
+ll_lru_delete(ll_lru_t *lru, uintptr_t key);
+/*%<
+ * Remove 'key' from the cache.  Return false if it was not cached.
+ *
+ * Progress condition: lock-free.
+ */
+
+size_t
+ll_lru_size(ll_lru_t *lru);
+/*%<
+ * Return the number of cached keys; it is exact only when no other
+ * thread is using the cache.
+ */
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ll_deque.h"
+#include "mlq.h"
+#include "pool.h"
+#include "tid.h"
+
+static thread_local uint32_t seed_v = 0;
+
+/*
+ * A value in a lane, stamped with the time of its push.  A pop peeks at the item at the head of a lane, which another
+ * thread may pop and put back to the pool meanwhile; the pool keeps the memory until the queue is destroyed, so the
+ * stamp read is then only stale, and it only makes the choice of the lane worse.
+ */
+typedef struct mlq_item {
+	atomic_uint_fast64_t stamp;
+	void *value; /* the pool links the free items through it */
+} mlq_item_t;
+
+/* The size is updated after the push and after the pop, so it can be off by the operations in flight */
+typedef struct mlq_lane {
+	alignas(128) atomic_int_fast64_t size;
+	ll_deque_t *deque;
+} mlq_lane_t;
+
+struct ll_mlq {
+	unsigned int nlanes;
+	mlq_lane_t *lanes;
+	ll_pool_t *items;
+};
+
+/* xorshift32, to pick the lanes */
+static inline uint32_t
+mlq_random(void) {
+	if (seed_v == 0) {
+		seed_v = 2463534242U + (uint32_t)ll_tid();
+	}
+	seed_v ^= seed_v << 13;
+	seed_v ^= seed_v >> 17;
+	seed_v ^= seed_v << 5;
+	return (seed_v);
+}
+
+static inline uint64_t
+mlq_now(void) {
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+ll_mlq_t *
+ll_mlq_new(unsigned int nlanes) {
+	ll_mlq_t *mlq = malloc(sizeof(*mlq));
+	assert(mlq != NULL);
+
+	if (nlanes == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		nlanes = 2 * ((online > 0) ? (unsigned int)online : 1);
+	}
+
+	mlq->nlanes = nlanes;
+	mlq->items = ll_pool_new(sizeof(mlq_item_t), alignof(mlq_item_t), offsetof(mlq_item_t, value), 0);
+	mlq->lanes = aligned_alloc(128, nlanes * sizeof(mlq->lanes[0]));
+	assert(mlq->lanes != NULL);
+
+	for (unsigned int i = 0; i < nlanes; i++) {
+		atomic_init(&mlq->lanes[i].size, 0);
+		mlq->lanes[i].deque = ll_deque_new(LL_DEQUE_HP);
+	}
+
+	return (mlq);
+}
+
+void
+ll_mlq_destroy(ll_mlq_t *mlq) {
+	assert(mlq != NULL);
+
+	for (unsigned int i = 0; i < mlq->nlanes; i++) {
+		ll_deque_destroy(mlq->lanes[i].deque);
+	}
+	free(mlq->lanes);
+	ll_pool_destroy(mlq->items);
+	free(mlq);
+}
+
+void
+ll_mlq_push(ll_mlq_t *mlq, void *value) {
+	mlq_lane_t *lane = &mlq->lanes[(unsigned int)ll_tid() % mlq->nlanes];
+
+	assert(value != NULL);
+
+	mlq_item_t *item = ll_pool_get(mlq->items);
+	atomic_store_explicit(&item->stamp, mlq_now(), memory_order_relaxed);
+	item->value = value;
+
+	ll_deque_push_right(lane->deque, item);
+	(void)atomic_fetch_add_explicit(&lane->size, 1, memory_order_relaxed);
+}
+
+/* The push time of the value at the head of the lane, UINT64_MAX if the lane is empty */
+static uint64_t
+mlq_head_stamp(mlq_lane_t *lane) {
+	mlq_item_t *item = ll_deque_peek_left(lane->deque);
+	return ((item != NULL) ? atomic_load_explicit(&item->stamp, memory_order_relaxed) : UINT64_MAX);
+}
+
+static void *
+mlq_pop_lane(ll_mlq_t *mlq, mlq_lane_t *lane) {
+	mlq_item_t *item = ll_deque_pop_left(lane->deque);
+	void *value = NULL;
+
+	if (item != NULL) {
+		(void)atomic_fetch_sub_explicit(&lane->size, 1, memory_order_relaxed);
+		value = item->value;
+		ll_pool_put(mlq->items, item);
+	}
+
+	return (value);
+}
+
+void *
+ll_mlq_pop(ll_mlq_t *mlq) {
+	unsigned int nlanes = mlq->nlanes;
+	mlq_lane_t *a = &mlq->lanes[mlq_random() % nlanes];
+	mlq_lane_t *b = &mlq->lanes[mlq_random() % nlanes];
+	void *value = NULL;
+
+	if (b != a && mlq_head_stamp(b) < mlq_head_stamp(a)) {
+		mlq_lane_t *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	value = mlq_pop_lane(mlq, a);
+	if (value != NULL) {
+		return (value);
+	}
+	if (b != a) {
+		value = mlq_pop_lane(mlq, b);
+		if (value != NULL) {
+			return (value);
+		}
+	}
+
+	/* Both choices came out empty, look everywhere before giving up */
+	unsigned int start = mlq_random() % nlanes;
+	for (unsigned int i = 0; i < nlanes; i++) {
+		value = mlq_pop_lane(mlq, &mlq->lanes[(start + i) % nlanes]);
+		if (value != NULL) {
+			return (value);
+		}
+	}
+
+	return (NULL);
+}
+
+unsigned int
+ll_mlq_lanes(ll_mlq_t *mlq) {
+	return (mlq->nlanes);
+}
+
+size_t
+ll_mlq_size(ll_mlq_t *mlq) {
+	int_fast64_t total = 0;
+
+	for (unsigned int i = 0; i < mlq->nlanes; i++) {
+		total += atomic_load_explicit(&mlq->lanes[i].size, memory_order_relaxed);
+	}
+
+	return ((total > 0) ? (size_t)total : 0);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*%
+ * Relaxed multi-lane FIFO queue.
+ *
+ * The queue is made of a number of lanes, every lane is a lock-free
+ * deque (see ll_deque.h) used as a FIFO queue, with its nodes reclaimed
+ * with hazard pointers.  A thread always pushes to the same lane, picked
+ * from its thread id, so producers hardly ever meet at the same tail.
+ * Every value is stamped with the time of its push.  A pop picks two
+ * random lanes, peeks at their heads and takes the older of the two (the
+ * power of two choices, after Hamza Rihani, Peter Sanders and Roman
+ * Dementiev: MultiQueues: Simpler, Faster, and Better Relaxed Concurrent
+ * Priority Queues).
+ *
+ * The order is relaxed: the values pushed by one thread come out in the
+ * order they were pushed, but a value can overtake values pushed by other
+ * threads.  Leaving the operations in flight aside, the oldest value in
+ * the queue is taken by the first pop that picks its lane, which a pop
+ * does with a probability of about 2 / nlanes, so it is overtaken by
+ * about nlanes / 2 younger values on average.  A value further back in
+ * its lane waits for the values ahead of it as well, each in turn, so
+ * the distance is in the order of the number of lanes only as long as
+ * the lanes are short.  The lane of a value is that of its thread rather
+ * than a random one as in the MultiQueues, so a thread that pushes much
+ * more than the others gets a longer lane, and its values fall further
+ * behind.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report an empty queue.
+ */
+
+typedef struct ll_mlq ll_mlq_t;
+
+ll_mlq_t *
+ll_mlq_new(unsigned int nlanes);
+/*%<
+ * Create a new empty queue with 'nlanes' lanes (or twice the number of
+ * CPUs if 'nlanes' is 0).
+ */
+
+void
+ll_mlq_destroy(ll_mlq_t *mlq);
+/*%<
+ * Destroy the queue.  No other thread may be using it.  The values still
+ * stored in the queue are not touched.
+ */
+
+void
+ll_mlq_push(ll_mlq_t *mlq, void *value);
+/*%<
+ * Push 'value' to the lane of the current thread.  'value' must not be
+ * NULL.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_mlq_pop(ll_mlq_t *mlq);
+/*%<
+ * Pop a value from one of the lanes, or return NULL if all the lanes were
+ * found empty.  As the lanes are looked at one after another, NULL does
+ * not mean that the queue was empty at any single point in time.
+ *
+ * Progress condition: lock-free.
+ */
+
+unsigned int
+ll_mlq_lanes(ll_mlq_t *mlq);
+/*%<
+ * Return the number of lanes.
+ */
+
+size_t
+ll_mlq_size(ll_mlq_t *mlq);
+/*%<
+ * Return the number of values in the queue.  The value is only a hint
+ * when other threads are using the queue.
+ */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "mpsc.h"
+
+/*
+ * The producers swing 'head' to the newest node, the consumer follows the
+ * next links from 'tail', the oldest node.  The stub node keeps the queue
+ * non-empty, so neither side ever has to look at the other's end, except
+ * when the consumer reaches the last node.
+ */
+struct ll_mpsc {
+	alignas(128) _Atomic(ll_mpsc_node_t *) head;
+	alignas(128) ll_mpsc_node_t *tail;
+	ll_mpsc_node_t stub;
+};
+
+ll_mpsc_t *
+ll_mpsc_new(void) {
+	ll_mpsc_t *mpsc = aligned_alloc(128, sizeof(*mpsc));
+	assert(mpsc != NULL);
+
+	atomic_init(&mpsc->stub.next, NULL);
+	atomic_init(&mpsc->head, &mpsc->stub);
+	mpsc->tail = &mpsc->stub;
+
+	return (mpsc);
+}
+
+void
+ll_mpsc_destroy(ll_mpsc_t *mpsc) {
+	assert(mpsc != NULL);
+	free(mpsc);
+}
+
+ll_mpsc_node_t *
+ll_mpsc_reserve(ll_mpsc_t *mpsc, ll_mpsc_node_t *node) {
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	return (atomic_exchange_explicit(&mpsc->head, node, memory_order_acq_rel));
+}
+
+void
+ll_mpsc_commit(ll_mpsc_t *mpsc, ll_mpsc_node_t *ticket, ll_mpsc_node_t *node) {
+	(void)mpsc;
+	atomic_store_explicit(&ticket->next, node, memory_order_release);
+}
+
+void
+ll_mpsc_push(ll_mpsc_t *mpsc, ll_mpsc_node_t *node) {
+	ll_mpsc_commit(mpsc, ll_mpsc_reserve(mpsc, node), node);
+}
+
+ll_mpsc_node_t *
+ll_mpsc_pop(ll_mpsc_t *mpsc) {
+	ll_mpsc_node_t *tail = mpsc->tail;
+	ll_mpsc_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if (tail == &mpsc->stub) {
+		if (next == NULL) {
+			return (NULL);
+		}
+		/* Skip over the stub */
+		mpsc->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+
+	if (next != NULL) {
+		mpsc->tail = next;
+		return (tail);
+	}
+
+	/* 'tail' is the last node, unless a producer is between its two steps */
+	if (tail != atomic_load_explicit(&mpsc->head, memory_order_acquire)) {
+		return (NULL);
+	}
+
+	/* Put the stub behind the last node, so that it can be taken out */
+	ll_mpsc_push(mpsc, &mpsc->stub);
+
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next != NULL) {
+		mpsc->tail = next;
+		return (tail);
+	}
+
+	return (NULL);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+
+/*%
+ * Intrusive multi-producer single-consumer queue.
+ *
+ * This is the intrusive MPSC node-based queue from Dmitry Vyukov: the
+ * caller embeds an ll_mpsc_node_t in its own items, and the queue links
+ * the items through it, so there is no copy and no allocation per item.
+ * A push is a single atomic exchange followed by a store; a pop is a few
+ * plain loads and stores.
+ *
+ * The push is split in two steps.  ll_mpsc_reserve() takes the place of
+ * the item in the queue order and ll_mpsc_commit() makes it visible to
+ * the consumer; the producer may fill in the item between the two.  Until
+ * the item is committed, the consumer cannot get past it and sees the
+ * queue as empty from that point on, so the gap should be kept short.
+ * ll_mpsc_push() does both steps at once.
+ *
+ * Any number of threads may push, exactly one thread may pop.
+ */
+
+typedef struct ll_mpsc_node {
+	_Atomic(struct ll_mpsc_node *) next;
+} ll_mpsc_node_t;
+
+typedef struct ll_mpsc ll_mpsc_t;
+
+ll_mpsc_t *
+ll_mpsc_new(void);
+/*%<
+ * Create a new empty queue.
+ */
+
+void
+ll_mpsc_destroy(ll_mpsc_t *mpsc);
+/*%<
+ * Destroy the queue.  No other thread may be using it.  The items still
+ * linked in the queue are not touched.
+ */
+
+ll_mpsc_node_t *
+ll_mpsc_reserve(ll_mpsc_t *mpsc, ll_mpsc_node_t *node);
+/*%<
+ * Take the place of 'node' at the end of the queue, and return the
+ * ticket that must be passed to ll_mpsc_commit().
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void
+ll_mpsc_commit(ll_mpsc_t *mpsc, ll_mpsc_node_t *ticket, ll_mpsc_node_t *node);
+/*%<
+ * Make 'node' visible to the consumer.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void
+ll_mpsc_push(ll_mpsc_t *mpsc, ll_mpsc_node_t *node);
+/*%<
+ * Append 'node' to the queue.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+ll_mpsc_node_t *
+ll_mpsc_pop(ll_mpsc_t *mpsc);
+/*%<
+ * Remove the oldest node from the queue and return it, or return NULL if
+ * the queue is empty or a node that has not been committed yet is in the
+ * way.  Consumer only.
+ *
+ * Progress condition: wait-free population oblivious; blocking on the
+ * producers that have reserved and not committed yet.
+ */
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "hp.h"
+#include "mwcas.h"
+#include "pool.h"
+
+/* A word that takes part in an operation holds its descriptor, or an RDCSS descriptor, tagged with MWCAS_TAG */
+#define MWCAS_TAG ((uintptr_t)0x02)
+
+enum {
+	MWCAS_UNDECIDED,  /* the words are being acquired */
+	MWCAS_VALIDATING, /* all acquired, the words only compared decide */
+	MWCAS_SUCCEEDED,
+	MWCAS_FAILED,
+};
+
+enum {
+	MWCAS_KIND_DESC,
+	MWCAS_KIND_RDCSS,
+	MWCAS_KIND_GONE, /* not a kind, the descriptor left the word */
+};
+
+/* Hazard pointers */
+enum {
+	HP_DESC,   /* the operation being helped */
+	HP_PEEK,   /* a descriptor found in a word */
+	HP_PARENT, /* the operation of an RDCSS descriptor found in a word */
+};
+
+typedef struct mwcas_word {
+	atomic_uintptr_t *addr;
+	uintptr_t old;
+	uintptr_t new;
+} mwcas_word_t;
+
+typedef struct mwcas {
+	unsigned int kind;
+	atomic_uint status;
+	size_t n;	  /* the words changed, sorted by the address */
+	size_t ncompared; /* the words only compared, after them */
+	mwcas_word_t words[LL_MWCAS_MAX_WORDS];
+} mwcas_t;
+
+/*
+ * Double-compare single-swap: 'addr' gets the descriptor of 'desc' in place of 'old' only while 'desc' is acquiring its
+ * words, so a helper that got there late cannot put the descriptor back into a word after the operation is over.  Every
+ * attempt has a fresh one.
+ */
+typedef struct mwcas_rdcss {
+	unsigned int kind;
+	mwcas_t *desc;
+	atomic_uintptr_t *addr;
+	uintptr_t old;
+} mwcas_rdcss_t;
+
+typedef struct mwcas_env {
+	ll_hp_t *hp;
+	ll_pool_t *descs;
+	ll_pool_t *rdcss;
+} mwcas_env_t;
+
+static _Atomic(mwcas_env_t *) mwcas_env;
+
+static_assert(MWCAS_TAG == LL_MWCAS_RESERVED, "the reserved bit is the tag");
+static_assert(alignof(mwcas_t) > MWCAS_TAG && alignof(mwcas_rdcss_t) > MWCAS_TAG,
+	      "the descriptors must leave room for the tag");
+
+static void
+mwcas_free(void *arg) {
+	mwcas_env_t *env = atomic_load(&mwcas_env);
+
+	if (*(unsigned int *)arg == MWCAS_KIND_DESC) {
+		ll_pool_put(env->descs, arg);
+	} else {
+		ll_pool_put(env->rdcss, arg);
+	}
+}
+
+/*
+ * The hazard pointers and the pools are created by the first ll_mwcas(), the threads that race for them keep the first
+ * set that got published.  A thread that finds a descriptor in a word has synchronized with its owner through that
+ * word, so it sees the set as well.
+ */
+static mwcas_env_t *
+mwcas_env_get(void) {
+	mwcas_env_t *env = atomic_load_explicit(&mwcas_env, memory_order_acquire);
+
+	if (env == NULL) {
+		mwcas_env_t *expected = NULL;
+		env = malloc(sizeof(*env));
+		assert(env != NULL);
+		*env = (mwcas_env_t){
+			.hp = ll_hp_new(3, mwcas_free),
+			.descs = ll_pool_new(sizeof(mwcas_t), alignof(mwcas_t), offsetof(mwcas_t, n), 0),
+			.rdcss = ll_pool_new(sizeof(mwcas_rdcss_t), alignof(mwcas_rdcss_t),
+					     offsetof(mwcas_rdcss_t, addr), 0),
+		};
+		if (!atomic_compare_exchange_strong(&mwcas_env, &expected, env)) {
+			/* Nothing has been retired to the set yet */
+			ll_hp_destroy(env->hp);
+			ll_pool_destroy(env->descs);
+			ll_pool_destroy(env->rdcss);
+			free(env);
+			env = expected;
+		}
+	}
+
+	return (env);
+}
+
+/*
+ * Return the status of the operation, deciding it first if its words have all been acquired.  The operation takes
+ * effect at the first read of a word only compared that decides it, the words changed hold the descriptor then.  A word
+ * that has left its old value does not come back to it while the operation runs (see ll_mwcas()), so the words read
+ * later held their old values at that moment as well.
+ */
+static unsigned int
+mwcas_status(mwcas_t *desc) {
+	unsigned int status = atomic_load(&desc->status);
+
+	if (status == MWCAS_VALIDATING) {
+		unsigned int decided = MWCAS_SUCCEEDED;
+		for (size_t i = desc->n; i < desc->n + desc->ncompared; i++) {
+			if (atomic_load(desc->words[i].addr) != desc->words[i].old) {
+				decided = MWCAS_FAILED;
+				break;
+			}
+		}
+		if (atomic_compare_exchange_strong(&desc->status, &status, decided)) {
+			status = decided;
+		}
+	}
+
+	return (status);
+}
+
+/* Put the words of a decided operation back, to the new values if it succeeded and to the old ones otherwise */
+static bool
+mwcas_finish(mwcas_t *desc) {
+	uintptr_t self = (uintptr_t)desc | MWCAS_TAG;
+	bool succeeded = (mwcas_status(desc) == MWCAS_SUCCEEDED);
+
+	for (size_t i = 0; i < desc->n; i++) {
+		mwcas_word_t *word = &desc->words[i];
+		uintptr_t expected = self;
+		(void)atomic_compare_exchange_strong(word->addr, &expected, succeeded ? word->new : word->old);
+	}
+
+	return (succeeded);
+}
+
+/*
+ * Replace the RDCSS descriptor 'value' in its word by the descriptor of its operation if the operation is still
+ * acquiring, and by the old value otherwise.  The operation may have been decided, and even finished, right after the
+ * descriptor went in; whoever put it there finishes the operation again.
+ */
+static void
+mwcas_rdcss_complete(mwcas_rdcss_t *rdcss, uintptr_t value) {
+	mwcas_t *desc = rdcss->desc;
+	bool acquiring = (atomic_load(&desc->status) == MWCAS_UNDECIDED);
+
+	if (atomic_compare_exchange_strong(rdcss->addr, &value, acquiring ? (uintptr_t)desc | MWCAS_TAG : rdcss->old) &&
+	    acquiring && atomic_load(&desc->status) != MWCAS_UNDECIDED) {
+		(void)mwcas_finish(desc);
+	}
+}
+
+/* Protect the descriptor 'value' read from 'addr' in the slot 'ihp' and return its kind */
+static unsigned int
+mwcas_peek(mwcas_env_t *env, int ihp, atomic_uintptr_t *addr, uintptr_t value) {
+	unsigned int *kind = (unsigned int *)ll_hp_protect_ptr(env->hp, ihp, value & ~MWCAS_TAG);
+
+	/* The descriptor cannot have been reclaimed if it is still in the word */
+	if (atomic_load(addr) != value) {
+		return (MWCAS_KIND_GONE);
+	}
+
+	return (*kind);
+}
+
+/*
+ * Complete the RDCSS descriptor 'value' of another thread, protected in HP_PEEK.  Its operation is safe while the
+ * descriptor is in the word: the thread that put it there holds the operation until it has completed it itself.
+ */
+static void
+mwcas_rdcss_help(mwcas_env_t *env, atomic_uintptr_t *addr, uintptr_t value) {
+	mwcas_rdcss_t *rdcss = (mwcas_rdcss_t *)(value & ~MWCAS_TAG);
+
+	(void)ll_hp_protect_ptr(env->hp, HP_PARENT, (uintptr_t)rdcss->desc);
+	if (atomic_load(addr) == value) {
+		mwcas_rdcss_complete(rdcss, value);
+	}
+	ll_hp_clear_one(env->hp, HP_PARENT);
+}
+
+/*
+ * Acquire the words of 'desc' in the order of their addresses, for its owner or as a helper, and decide the operation
+ * if they have all been acquired or one has not got its old value.  Return 0 when the operation is past acquiring,
+ * otherwise the descriptor of another operation that holds the word at '*addrp', which has to be helped first.
+ */
+static uintptr_t
+mwcas_acquire(mwcas_env_t *env, mwcas_t *desc, atomic_uintptr_t **addrp) {
+	uintptr_t self = (uintptr_t)desc | MWCAS_TAG;
+	mwcas_rdcss_t *rdcss = NULL;
+	uintptr_t conflict = 0;
+	unsigned int status = (desc->ncompared > 0) ? MWCAS_VALIDATING : MWCAS_SUCCEEDED;
+
+	for (size_t i = 0; i < desc->n && conflict == 0; i++) {
+		mwcas_word_t *word = &desc->words[i];
+		while (atomic_load(&desc->status) == MWCAS_UNDECIDED) {
+			if (rdcss == NULL) {
+				rdcss = ll_pool_get(env->rdcss);
+				rdcss->kind = MWCAS_KIND_RDCSS;
+				rdcss->desc = desc;
+			}
+			rdcss->addr = word->addr;
+			rdcss->old = word->old;
+
+			uintptr_t value = word->old;
+			uintptr_t tagged = (uintptr_t)rdcss | MWCAS_TAG;
+			if (atomic_compare_exchange_strong(word->addr, &value, tagged)) {
+				/* Once out of the word, the descriptor may still be held by the threads that found it */
+				mwcas_rdcss_complete(rdcss, tagged);
+				ll_hp_retire(env->hp, tagged & ~MWCAS_TAG);
+				rdcss = NULL;
+				if (atomic_load(word->addr) == self) {
+					break;
+				}
+				continue;
+			}
+			if (value == self) {
+				break;
+			}
+			if (!ll_mwcas_is_descriptor(value)) {
+				status = MWCAS_FAILED;
+				break;
+			}
+
+			unsigned int kind = mwcas_peek(env, HP_PEEK, word->addr, value);
+			if (kind == MWCAS_KIND_RDCSS) {
+				mwcas_rdcss_help(env, word->addr, value);
+			}
+			ll_hp_clear_one(env->hp, HP_PEEK);
+			if (kind == MWCAS_KIND_DESC) {
+				*addrp = word->addr;
+				conflict = value;
+				break;
+			}
+		}
+		if (status == MWCAS_FAILED) {
+			break;
+		}
+	}
+
+	if (rdcss != NULL) {
+		/* Never got into a word */
+		ll_pool_put(env->rdcss, rdcss);
+	}
+	if (conflict == 0) {
+		unsigned int undecided = MWCAS_UNDECIDED;
+		(void)atomic_compare_exchange_strong(&desc->status, &undecided, status);
+	}
+
+	return (conflict);
+}
+
+/*
+ * Help the operation whose descriptor 'value' has been read from 'addr' to its end, and the operations in its way
+ * before it.  An operation is in the way at a word further on in the order of the addresses than the one it holds up,
+ * so the chain of operations helped is finite.
+ */
+static void
+mwcas_help(mwcas_env_t *env, atomic_uintptr_t *addr, uintptr_t value) {
+	while (mwcas_peek(env, HP_DESC, addr, value) == MWCAS_KIND_DESC) {
+		mwcas_t *desc = (mwcas_t *)(value & ~MWCAS_TAG);
+		uintptr_t conflict = mwcas_acquire(env, desc, &addr);
+		if (conflict == 0 || atomic_load(&desc->status) != MWCAS_UNDECIDED) {
+			/* Decided meanwhile, by another helper */
+			(void)mwcas_finish(desc);
+		}
+		if (conflict == 0) {
+			break;
+		}
+		value = conflict;
+	}
+	ll_hp_clear_one(env->hp, HP_DESC);
+}
+
+bool
+ll_mwcas(size_t n, atomic_uintptr_t *const addrs[], const uintptr_t olds[], const uintptr_t news[]) {
+	assert(n > 0 && n <= LL_MWCAS_MAX_WORDS);
+
+	mwcas_env_t *env = mwcas_env_get();
+	mwcas_t *desc = ll_pool_get(env->descs);
+
+	desc->kind = MWCAS_KIND_DESC;
+	atomic_store_explicit(&desc->status, MWCAS_UNDECIDED, memory_order_relaxed);
+	desc->n = 0;
+	desc->ncompared = 0;
+
+	mwcas_word_t compared[LL_MWCAS_MAX_WORDS];
+	for (size_t i = 0; i < n; i++) {
+		assert(!ll_mwcas_is_descriptor(olds[i]) && !ll_mwcas_is_descriptor(news[i]));
+		for (size_t j = 0; j < i; j++) {
+			assert(addrs[j] != addrs[i]);
+		}
+
+		mwcas_word_t word = { .addr = addrs[i], .old = olds[i], .new = news[i] };
+		if (olds[i] == news[i]) {
+			compared[desc->ncompared++] = word;
+			continue;
+		}
+
+		/* Insertion sort, there are a few words at most */
+		size_t j = desc->n++;
+		while (j > 0 && (uintptr_t)desc->words[j - 1].addr > (uintptr_t)addrs[i]) {
+			desc->words[j] = desc->words[j - 1];
+			j--;
+		}
+		desc->words[j] = word;
+	}
+	for (size_t i = 0; i < desc->ncompared; i++) {
+		desc->words[desc->n + i] = compared[i];
+	}
+
+	/* The descriptor is published by its first word, the owner needs no hazard pointer for it */
+	atomic_uintptr_t *addr;
+	uintptr_t conflict;
+	while ((conflict = mwcas_acquire(env, desc, &addr)) != 0) {
+		mwcas_help(env, addr, conflict);
+	}
+
+	bool succeeded = mwcas_finish(desc);
+	ll_hp_retire(env->hp, (uintptr_t)desc);
+
+	return (succeeded);
+}
+
+/*
+ * The operation takes effect when it is decided, until then the words keep their old values; one that has acquired
+ * all its words is decided on the way, as the readers must not return an old value past that moment.  A decided
+ * operation is finished on the way as well, that only does what its owner is going to do anyway.
+ */
+uintptr_t
+ll_mwcas_read(atomic_uintptr_t *addr) {
+	mwcas_env_t *env = NULL;
+
+	while (true) {
+		uintptr_t value = atomic_load(addr);
+		if (!ll_mwcas_is_descriptor(value)) {
+			return (value);
+		}
+
+		if (env == NULL) {
+			env = mwcas_env_get();
+		}
+		unsigned int kind = mwcas_peek(env, HP_PEEK, addr, value);
+		if (kind == MWCAS_KIND_RDCSS) {
+			/* The operation has not got the word yet, or is over */
+			value = ((mwcas_rdcss_t *)(value & ~MWCAS_TAG))->old;
+		} else if (kind == MWCAS_KIND_DESC) {
+			mwcas_t *desc = (mwcas_t *)(value & ~MWCAS_TAG);
+			unsigned int status = mwcas_status(desc);
+			size_t i = 0;
+			while (desc->words[i].addr != addr) {
+				i++;
+			}
+			value = (status == MWCAS_SUCCEEDED) ? desc->words[i].new : desc->words[i].old;
+			if (status != MWCAS_UNDECIDED) {
+				(void)mwcas_finish(desc);
+			}
+		}
+		ll_hp_clear_one(env->hp, HP_PEEK);
+		if (kind != MWCAS_KIND_GONE) {
+			return (value);
+		}
+	}
+}
+
+void
+ll_mwcas_resolve(atomic_uintptr_t *addr) {
+	mwcas_env_t *env = mwcas_env_get();
+	uintptr_t value = atomic_load(addr);
+
+	while (ll_mwcas_is_descriptor(value)) {
+		unsigned int kind = mwcas_peek(env, HP_PEEK, addr, value);
+		if (kind == MWCAS_KIND_RDCSS) {
+			mwcas_rdcss_help(env, addr, value);
+		}
+		ll_hp_clear_one(env->hp, HP_PEEK);
+		if (kind == MWCAS_KIND_DESC) {
+			mwcas_help(env, addr, value);
+		}
+		value = atomic_load(addr);
+	}
+}
+
+void
+ll_mwcas_destroy(void) {
+	mwcas_env_t *env = atomic_load(&mwcas_env);
+
+	if (env != NULL) {
+		/* The descriptors still retired go back to the pools, the pools take the rest with them */
+		ll_hp_destroy(env->hp);
+		atomic_store(&mwcas_env, NULL);
+		ll_pool_destroy(env->descs);
+		ll_pool_destroy(env->rdcss);
+		free(env);
+	}
+}
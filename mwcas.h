@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*%
+ * Multi-word compare-and-swap.
+ *
+ * The operation is described by a descriptor, as in Timothy L. Harris,
+ * Keir Fraser and Ian A. Pratt: A Practical Multi-Word Compare-and-Swap
+ * Operation.  The descriptor is swapped into the words one by one, in
+ * the order of their addresses, each time with a double-compare
+ * single-swap (RDCSS) that only succeeds while the operation is still
+ * acquiring; once it is in all of them, the operation succeeds and the
+ * words get their new values, otherwise they get their old values back.
+ *
+ * Any thread may acquire the words for an operation: a thread that finds
+ * a descriptor in a word it needs helps that operation to its end before
+ * it goes on with its own, so no operation is ever aborted by another
+ * one.  The words are acquired in the order of their addresses, an
+ * operation that holds one up is further along, and the helping ends.
+ *
+ * Words that are only compared, given the same old and new value, are
+ * not acquired, as with the read set of the PMwCAS of Tianzheng Wang et
+ * al.: they are checked once all the other words have been acquired,
+ * and the first thread to check them decides the operation.  A word
+ * that many operations only compare, e.g. a version or the head of a
+ * whole structure, is then not a point where they queue up.
+ *
+ * A reader that finds a descriptor in a word looks through it: the
+ * operation takes effect at the moment it is decided, so until then the
+ * word still has its old value.  A reader only decides an operation that
+ * is already past acquiring its words, as it cannot tell otherwise.
+ *
+ * The words must be read with ll_mwcas_read() (or checked with
+ * ll_mwcas_is_descriptor() first) wherever they may take part in an
+ * operation, and the values stored in them must leave the bits in
+ * LL_MWCAS_RESERVED clear; the lowest bit is left to the caller, e.g.
+ * for marking pointers.  A plain CAS on such a word simply fails while
+ * an operation is in progress, the writer then calls ll_mwcas_resolve()
+ * before it tries again.
+ *
+ * The descriptors come from two pools and are retired to one set of
+ * hazard pointers, which live as long as the process; ll_mwcas_destroy()
+ * frees them at the end.
+ */
+
+#define LL_MWCAS_MAX_WORDS 8		     /*%< words changed by one operation */
+#define LL_MWCAS_RESERVED  ((uintptr_t)0x02) /*%< the bit that tags the descriptors */
+
+static inline bool
+ll_mwcas_is_descriptor(uintptr_t value) {
+	return ((value & LL_MWCAS_RESERVED) != 0);
+}
+/*%<
+ * Return whether 'value' read from a word is a descriptor rather than
+ * the value of the word.
+ */
+
+bool
+ll_mwcas(size_t n, atomic_uintptr_t *const addrs[], const uintptr_t olds[], const uintptr_t news[]);
+/*%<
+ * Atomically store 'news[i]' to '*addrs[i]' for every 'i' below 'n', if
+ * every '*addrs[i]' is 'olds[i]'.  Return whether the words were
+ * changed.  A word that is only compared is given the same old and new
+ * value; it is never written, and it must not hold a descriptor.  If
+ * more than one word is only compared, each of them must not come back
+ * to its old value once it has left it while the operation runs, e.g.
+ * a version, or a pointer whose object cannot be reused meanwhile.  The
+ * addresses must be distinct and 'n' must not exceed LL_MWCAS_MAX_WORDS.
+ *
+ * Progress condition: lock-free.
+ */
+
+uintptr_t
+ll_mwcas_read(atomic_uintptr_t *addr);
+/*%<
+ * Return the value of the word at 'addr'.  The operation that may be
+ * changing the word is not held up: the value returned is the new one
+ * if the operation has succeeded already and the old one otherwise.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_mwcas_resolve(atomic_uintptr_t *addr);
+/*%<
+ * Get the operation that is changing the word at 'addr' out of the way
+ * by helping it to its end.  For a writer whose CAS on the word failed
+ * because it held a descriptor.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_mwcas_destroy(void);
+/*%<
+ * Free the descriptors and the hazard pointers.  Only for
+ * the end of the process, e.g. to keep a leak checker quiet: no thread
+ * may be in ll_mwcas() or read a word that took part in one, and
+ * ll_mwcas() must not be called anymore.
+ */
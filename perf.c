@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf.h"
+
+struct ll_perf {
+	int fd[LL_PERF_NCOUNTERS]; /* -1 when not available */
+};
+
+static const char *perf_names[LL_PERF_NCOUNTERS] = {
+	"cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+};
+
+#if defined(__linux__)
+
+#define CACHE_CONFIG(cache, op, result) \
+	((PERF_COUNT_HW_CACHE_##cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} perf_events[LL_PERF_NCOUNTERS] = {
+	[LL_PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[LL_PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[LL_PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_CONFIG(L1D, READ, MISS) },
+	[LL_PERF_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[LL_PERF_DTLB_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_CONFIG(DTLB, READ, MISS) },
+};
+
+static int
+perf_open(ll_perf_counter_t counter) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = perf_events[counter].type;
+	attr.config = perf_events[counter].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	/* This thread, any CPU */
+	return ((int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif /* __linux__ */
+
+ll_perf_t *
+ll_perf_new(void) {
+	ll_perf_t *perf = malloc(sizeof(*perf));
+	assert(perf != NULL);
+
+	for (size_t i = 0; i < LL_PERF_NCOUNTERS; i++) {
+#if defined(__linux__)
+		perf->fd[i] = perf_open(i);
+#else
+		perf->fd[i] = -1;
+#endif
+	}
+
+	return (perf);
+}
+
+void
+ll_perf_destroy(ll_perf_t *perf) {
+	assert(perf != NULL);
+
+	for (size_t i = 0; i < LL_PERF_NCOUNTERS; i++) {
+		if (perf->fd[i] >= 0) {
+			(void)close(perf->fd[i]);
+		}
+	}
+	free(perf);
+}
+
+void
+ll_perf_start(ll_perf_t *perf) {
+#if defined(__linux__)
+	for (size_t i = 0; i < LL_PERF_NCOUNTERS; i++) {
+		if (perf->fd[i] >= 0) {
+			(void)ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+			(void)ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#else
+	(void)perf;
+#endif
+}
+
+void
+ll_perf_stop(ll_perf_t *perf) {
+#if defined(__linux__)
+	for (size_t i = 0; i < LL_PERF_NCOUNTERS; i++) {
+		if (perf->fd[i] >= 0) {
+			(void)ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+#else
+	(void)perf;
+#endif
+}
+
+bool
+ll_perf_read(ll_perf_t *perf, ll_perf_counter_t counter, uint64_t *valuep) {
+	struct {
+		uint64_t value;
+		uint64_t enabled;
+		uint64_t running;
+	} data;
+
+	assert(counter < LL_PERF_NCOUNTERS);
+
+	if (perf->fd[counter] < 0 || read(perf->fd[counter], &data, sizeof(data)) != sizeof(data)) {
+		return (false);
+	}
+	if (data.running == 0) {
+		/* Never got on the PMU */
+		return (false);
+	}
+	if (data.running < data.enabled) {
+		data.value = (uint64_t)((double)data.value * (double)data.enabled / (double)data.running);
+	}
+	*valuep = data.value;
+
+	return (true);
+}
+
+const char *
+ll_perf_name(ll_perf_counter_t counter) {
+	assert(counter < LL_PERF_NCOUNTERS);
+	return (perf_names[counter]);
+}
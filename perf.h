@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*%
+ * Hardware performance counters of the calling thread, on Linux
+ * perf_event_open(2).
+ *
+ * Every counter is opened on its own, so a counter the CPU, the kernel
+ * or the perf_event_paranoid setting does not allow is left out without
+ * taking the others with it.  When the kernel has to multiplex the
+ * counters, the counts are scaled up to the whole measured time.  On
+ * other systems no counter is ever available.
+ *
+ * The counters count the user-space work of the thread that created them
+ * only, so every thread needs its own ll_perf_t.
+ */
+
+typedef struct ll_perf ll_perf_t;
+
+typedef enum ll_perf_counter {
+	LL_PERF_CYCLES,
+	LL_PERF_INSTRUCTIONS,
+	LL_PERF_L1D_MISSES,  /*%< L1 data cache read misses */
+	LL_PERF_LLC_MISSES,  /*%< last level cache misses */
+	LL_PERF_DTLB_MISSES, /*%< data TLB read misses */
+	LL_PERF_NCOUNTERS,
+} ll_perf_counter_t;
+
+ll_perf_t *
+ll_perf_new(void);
+/*%<
+ * Open the counters for the calling thread, stopped.
+ */
+
+void
+ll_perf_destroy(ll_perf_t *perf);
+/*%<
+ * Close the counters.
+ */
+
+void
+ll_perf_start(ll_perf_t *perf);
+/*%<
+ * Reset the counters and start counting.
+ */
+
+void
+ll_perf_stop(ll_perf_t *perf);
+/*%<
+ * Stop counting.
+ */
+
+bool
+ll_perf_read(ll_perf_t *perf, ll_perf_counter_t counter, uint64_t *valuep);
+/*%<
+ * Store the count of 'counter' to 'valuep' and return true, or return
+ * false if the counter is not available.
+ */
+
+const char *
+ll_perf_name(ll_perf_counter_t counter);
+/*%<
+ * Return the name of 'counter', usable as a CSV column.
+ */
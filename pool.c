@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "pool.h"
+#include "tid.h"
+
+#define POOL_DEFAULT_SLAB 256
+#define POOL_CACHE_SLABS  2 /* Flush the thread cache when it holds this many slabs */
+
+#define POOL_ARENA_SLAB (2 * 1024 * 1024) /* One huge page */
+#define POOL_MAX_NODES	64		  /* NUMA nodes with a depot of their own, the rest share them */
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+#define POOL_MAP_HUGETLB (MAP_HUGETLB | (21 << MAP_HUGE_SHIFT)) /* 2M pages, even if the default size is 1G */
+#endif
+
+#define POOL_MPOL_PREFERRED 1 /* from <linux/mempolicy.h> */
+
+typedef struct pool_slab {
+	struct pool_slab *next;
+	unsigned int node;    /* arena only: the depot of the objects */
+	atomic_size_t carved; /* arena only: the objects handed out so far */
+} pool_slab_t;
+
+/* The objects of a NUMA node, an ordinary pool has only node 0 */
+typedef struct pool_node {
+	alignas(128) atomic_uintptr_t depot; /* chains of objects flushed by the threads */
+	atomic_uintptr_t slab;		     /* arena only: the slab being carved */
+} pool_node_t;
+
+/* The cache is used by its owner only, keep them apart */
+typedef struct pool_cache {
+	alignas(128) void *head;
+	size_t count;
+	unsigned int node; /* where the objects in the cache belong */
+} pool_cache_t;
+
+struct ll_pool {
+	size_t size;
+	size_t align;
+	size_t offset;
+	size_t slab;
+	size_t stride;
+	size_t header;
+	bool arena;
+	size_t arena_objects; /* arena only: objects per slab */
+	atomic_uintptr_t slabs; /* push only, freed in ll_pool_destroy() */
+	atomic_size_t nslabs;
+	pool_node_t nodes[POOL_MAX_NODES];
+	pool_cache_t caches[LL_TID_MAX];
+};
+
+#define pool_next(pool, obj) (*(void **)((char *)(obj) + (pool)->offset))
+
+#define roundup(x, a) ((((x) + (a) - 1) / (a)) * (a))
+
+ll_pool_t *
+ll_pool_new(size_t size, size_t align, size_t offset, size_t slab) {
+	ll_pool_t *pool = aligned_alloc(128, sizeof(*pool));
+	assert(pool != NULL);
+
+	if (align == 0) {
+		align = sizeof(void *);
+	}
+	if (slab == 0) {
+		slab = POOL_DEFAULT_SLAB;
+	}
+	assert((align & (align - 1)) == 0);
+	assert(offset + sizeof(void *) <= size);
+	assert(offset % alignof(void *) == 0);
+
+	*pool = (ll_pool_t){
+		.size = size,
+		.align = align,
+		.offset = offset,
+		.slab = slab,
+		.stride = roundup(size, align),
+		.header = roundup(sizeof(pool_slab_t), align),
+	};
+	atomic_init(&pool->slabs, 0);
+	atomic_init(&pool->nslabs, 0);
+	for (size_t i = 0; i < POOL_MAX_NODES; i++) {
+		atomic_init(&pool->nodes[i].depot, 0);
+		atomic_init(&pool->nodes[i].slab, 0);
+	}
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		pool->caches[i] = (pool_cache_t){ .head = NULL };
+	}
+
+	return (pool);
+}
+
+ll_pool_t *
+ll_pool_new_arena(size_t size, size_t align, size_t offset) {
+	ll_pool_t *pool = ll_pool_new(size, align, offset, 0);
+
+	assert(pool->header + pool->stride <= POOL_ARENA_SLAB);
+	pool->arena = true;
+	pool->arena_objects = (POOL_ARENA_SLAB - pool->header) / pool->stride;
+
+	return (pool);
+}
+
+void
+ll_pool_destroy(ll_pool_t *pool) {
+	assert(pool != NULL);
+
+	pool_slab_t *slab = (pool_slab_t *)atomic_load(&pool->slabs);
+	while (slab != NULL) {
+		pool_slab_t *next = slab->next;
+		if (pool->arena) {
+			(void)munmap(slab, POOL_ARENA_SLAB);
+		} else {
+			free(slab);
+		}
+		slab = next;
+	}
+	free(pool);
+}
+
+/*
+ * Allocate a new slab and carve it into the thread cache.  The slab is
+ * zeroed, so the objects look like they have never been used.
+ */
+static void
+pool_carve(ll_pool_t *pool, pool_cache_t *cache, pool_slab_t *slab, size_t first, size_t last) {
+	char *base = (char *)slab + pool->header;
+	for (size_t i = last; i > first; i--) {
+		void *obj = base + (i - 1) * pool->stride;
+		pool_next(pool, obj) = cache->head;
+		cache->head = obj;
+	}
+	cache->count += last - first;
+}
+
+static void
+pool_link(ll_pool_t *pool, pool_slab_t *slab) {
+	uintptr_t old = atomic_load(&pool->slabs);
+	do {
+		slab->next = (pool_slab_t *)old;
+	} while (!atomic_compare_exchange_weak(&pool->slabs, &old, (uintptr_t)slab));
+	(void)atomic_fetch_add(&pool->nslabs, 1);
+}
+
+/* The NUMA node the calling thread runs on, or 0 if the system does not tell */
+static unsigned int
+pool_this_node(void) {
+	unsigned int cpu = 0, node = 0;
+#if defined(__linux__) && defined(SYS_getcpu)
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+		node = 0;
+	}
+#endif
+	(void)cpu;
+	return (node);
+}
+
+/*
+ * Map a slab aligned to its size, so that the slab of an object is found by masking its address.  The slab comes
+ * from the reserved 2M huge pages if there are any, otherwise transparent huge pages are asked to back it.  Either way
+ * the memory is bound to 'node' if the kernel lets us, and it is zeroed.
+ */
+static pool_slab_t *
+pool_map(unsigned int node) {
+	char *slab = MAP_FAILED;
+
+#if defined(POOL_MAP_HUGETLB)
+	slab = mmap(NULL, POOL_ARENA_SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | POOL_MAP_HUGETLB, -1,
+		    0);
+	if (slab != MAP_FAILED && ((uintptr_t)slab & (POOL_ARENA_SLAB - 1)) != 0) {
+		(void)munmap(slab, POOL_ARENA_SLAB);
+		slab = MAP_FAILED;
+	}
+#endif
+	if (slab == MAP_FAILED) {
+		/* Map twice the size and trim it down to an aligned slab */
+		char *raw = mmap(NULL, 2 * POOL_ARENA_SLAB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(raw != MAP_FAILED);
+		slab = (char *)roundup((uintptr_t)raw, POOL_ARENA_SLAB);
+		if (slab > raw) {
+			(void)munmap(raw, (size_t)(slab - raw));
+		}
+		if (raw + 2 * POOL_ARENA_SLAB > slab + POOL_ARENA_SLAB) {
+			(void)munmap(slab + POOL_ARENA_SLAB, (size_t)(raw + 2 * POOL_ARENA_SLAB - (slab + POOL_ARENA_SLAB)));
+		}
+#if defined(MADV_HUGEPAGE)
+		(void)madvise(slab, POOL_ARENA_SLAB, MADV_HUGEPAGE);
+#endif
+	}
+
+#if defined(__linux__) && defined(SYS_mbind)
+	/* Best effort, the first touch puts the pages near the thread anyway */
+	unsigned long mask[POOL_MAX_NODES / (8 * sizeof(unsigned long)) + 1] = { 0 };
+	if (node < 8 * sizeof(mask)) {
+		mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+		(void)syscall(SYS_mbind, slab, POOL_ARENA_SLAB, POOL_MPOL_PREFERRED, mask, 8 * sizeof(mask), 0);
+	}
+#else
+	(void)node;
+#endif
+
+	return ((pool_slab_t *)slab);
+}
+
+/*
+ * Carve the next run of objects of the slab of the node of the cache, mapping a new slab when it is used up.  The
+ * threads of a node share the slab, so the objects handed out together are close to each other.
+ */
+static void
+pool_grow_arena(ll_pool_t *pool, pool_cache_t *cache) {
+	pool_node_t *node = &pool->nodes[cache->node % POOL_MAX_NODES];
+
+	for (;;) {
+		pool_slab_t *slab = (pool_slab_t *)atomic_load(&node->slab);
+		if (slab != NULL) {
+			size_t first = atomic_fetch_add(&slab->carved, pool->slab);
+			if (first < pool->arena_objects) {
+				size_t last = first + pool->slab;
+				pool_carve(pool, cache, slab, first, (last < pool->arena_objects) ? last : pool->arena_objects);
+				return;
+			}
+		}
+
+		pool_slab_t *fresh = pool_map(cache->node);
+		fresh->node = cache->node % POOL_MAX_NODES;
+		atomic_init(&fresh->carved, 0);
+		if (!atomic_compare_exchange_strong(&node->slab, &(uintptr_t){ (uintptr_t)slab }, (uintptr_t)fresh)) {
+			/* Somebody else was faster, nobody has seen ours */
+			(void)munmap(fresh, POOL_ARENA_SLAB);
+			continue;
+		}
+		pool_link(pool, fresh);
+	}
+}
+
+static void
+pool_grow(ll_pool_t *pool, pool_cache_t *cache) {
+	if (pool->arena) {
+		pool_grow_arena(pool, cache);
+		return;
+	}
+
+	size_t bytes = roundup(pool->header + pool->slab * pool->stride, pool->align);
+	pool_slab_t *slab = aligned_alloc(pool->align, bytes);
+	assert(slab != NULL);
+	memset(slab, 0, bytes);
+
+	pool_link(pool, slab);
+	pool_carve(pool, cache, slab, 0, pool->slab);
+}
+
+/*
+ * Take everything from the depot.  Exchanging the whole stack for NULL
+ * does not suffer from the ABA problem that a single pop would have.
+ */
+static void
+pool_refill(ll_pool_t *pool, pool_cache_t *cache) {
+	/* The cache is empty, it can move to another node */
+	if (pool->arena) {
+		cache->node = pool_this_node();
+	}
+
+	void *chain = (void *)atomic_exchange(&pool->nodes[cache->node % POOL_MAX_NODES].depot, 0);
+	if (chain == NULL) {
+		pool_grow(pool, cache);
+		return;
+	}
+
+	cache->head = chain;
+	cache->count = 0;
+	for (void *obj = chain; obj != NULL; obj = pool_next(pool, obj)) {
+		cache->count++;
+	}
+}
+
+static void
+pool_push(ll_pool_t *pool, pool_node_t *node, void *first, void *last) {
+	uintptr_t old = atomic_load(&node->depot);
+	do {
+		pool_next(pool, last) = (void *)old;
+	} while (!atomic_compare_exchange_weak(&node->depot, &old, (uintptr_t)first));
+}
+
+static void
+pool_flush(ll_pool_t *pool, pool_cache_t *cache) {
+	void *first = cache->head;
+	void *last = first;
+	while (pool_next(pool, last) != NULL) {
+		last = pool_next(pool, last);
+	}
+
+	pool_push(pool, &pool->nodes[cache->node % POOL_MAX_NODES], first, last);
+
+	cache->head = NULL;
+	cache->count = 0;
+}
+
+void *
+ll_pool_get(ll_pool_t *pool) {
+	pool_cache_t *cache = &pool->caches[ll_tid()];
+
+	if (cache->head == NULL) {
+		pool_refill(pool, cache);
+	}
+
+	void *obj = cache->head;
+	cache->head = pool_next(pool, obj);
+	cache->count--;
+
+	return (obj);
+}
+
+void
+ll_pool_put(ll_pool_t *pool, void *ptr) {
+	pool_cache_t *cache = &pool->caches[ll_tid()];
+
+	assert(ptr != NULL);
+
+	if (pool->arena) {
+		/* An object from another node goes straight home */
+		pool_slab_t *slab = (pool_slab_t *)((uintptr_t)ptr & ~(uintptr_t)(POOL_ARENA_SLAB - 1));
+		if (slab->node != cache->node % POOL_MAX_NODES) {
+			pool_push(pool, &pool->nodes[slab->node], ptr, ptr);
+			return;
+		}
+	}
+
+	pool_next(pool, ptr) = cache->head;
+	cache->head = ptr;
+	cache->count++;
+
+	if (cache->count >= POOL_CACHE_SLABS * pool->slab) {
+		pool_flush(pool, cache);
+	}
+}
+
+size_t
+ll_pool_slabs(ll_pool_t *pool) {
+	return (atomic_load(&pool->nslabs));
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*%
+ * Type-stable object pool.
+ *
+ * The pool hands out fixed-size objects carved from slabs.  A freed
+ * object goes back to the cache of the thread that freed it, and the
+ * memory is returned to malloc only when the pool is destroyed, so a
+ * pointer to a freed object always points to an object of the same
+ * type.  This is what reference counting schemes such as Valois' or
+ * Michael and Scott's require, as they may increment the counter of a
+ * node that has just been freed.
+ *
+ * The pool keeps its free list in one pointer-sized word of every free
+ * object (at 'offset') and never touches the rest of the object, not
+ * even when it is carved from a fresh (zeroed) slab.
+ */
+
+typedef struct ll_pool ll_pool_t;
+
+ll_pool_t *
+ll_pool_new(size_t size, size_t align, size_t offset, size_t slab);
+/*%<
+ * Create a new pool of objects of 'size' bytes aligned to 'align'
+ * bytes (or the pointer size if 'align' is 0).  'offset' is the offset
+ * of a pointer-sized field that the pool may overwrite while the object
+ * is free.  The pool grows by 'slab' objects at a time (or a reasonable
+ * default value if 'slab' is 0).
+ */
+
+ll_pool_t *
+ll_pool_new_arena(size_t size, size_t align, size_t offset);
+/*%<
+ * Same as ll_pool_new(), but carve the objects from 2M slabs mapped
+ * with mmap() and aligned to their size.  The slabs come from huge pages
+ * if the system has any reserved, otherwise transparent huge pages are
+ * requested, so a list walk does not thrash the TLB.
+ *
+ * Every NUMA node has its own slabs and depot: a thread gets the objects
+ * of the node it runs on, and an object put back on another node is
+ * sent home.  The placement is best effort, the pool works the same on
+ * a machine (or a kernel) without NUMA.
+ */
+
+void
+ll_pool_destroy(ll_pool_t *pool);
+/*%<
+ * Destroy the pool and return all the slabs to malloc.  Objects that
+ * have not been put back are freed as well.
+ */
+
+void *
+ll_pool_get(ll_pool_t *pool);
+/*%<
+ * Get an object from the pool.  The contents of the object are whatever
+ * the previous user left there, or zero if the object is new.
+ *
+ * Progress condition: wait-free population oblivious, unless the
+ * thread cache is empty, then lock-free.
+ */
+
+void
+ll_pool_put(ll_pool_t *pool, void *ptr);
+/*%<
+ * Put an object back to the pool.
+ *
+ * Progress condition: wait-free population oblivious, unless the
+ * thread cache overflows, then lock-free.
+ */
+
+size_t
+ll_pool_slabs(ll_pool_t *pool);
+/*%<
+ * Return the number of slabs allocated so far.
+ */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "cm.h"
+#include "hp.h"
+#include "pool.h"
+#include "queue.h"
+
+#define HP_CURR 0 /* head or tail */
+#define HP_NEXT 1
+
+typedef struct queue_node {
+	atomic_uintptr_t next;
+	void *value;
+	struct ll_queue *queue;
+} queue_node_t;
+
+/*
+ * 'head' points to the dummy node, the values live in the nodes after it;
+ * the consumers and the producers work on different cache lines.
+ */
+struct ll_queue {
+	alignas(128) atomic_uintptr_t head;
+	alignas(128) atomic_uintptr_t tail;
+	alignas(128) ll_hp_t *hp;
+	ll_cm_t *cm;
+	ll_pool_t *pool;
+};
+
+static void
+queue_node_delete(void *arg) {
+	queue_node_t *node = (queue_node_t *)arg;
+	ll_pool_put(node->queue->pool, node);
+}
+
+static queue_node_t *
+queue_node_new(ll_queue_t *queue, void *value) {
+	queue_node_t *node = ll_pool_get(queue->pool);
+	node->value = value;
+	node->queue = queue;
+	atomic_store_explicit(&node->next, 0, memory_order_relaxed);
+	return (node);
+}
+
+ll_queue_t *
+ll_queue_new(void) {
+	ll_queue_t *queue = aligned_alloc(128, sizeof(*queue));
+	assert(queue != NULL);
+
+	queue->hp = ll_hp_new(2, queue_node_delete);
+	queue->cm = ll_cm_new(LL_CM_BACKOFF, 0, 0);
+	queue->pool = ll_pool_new(sizeof(queue_node_t), alignof(queue_node_t), offsetof(queue_node_t, value), 0);
+
+	queue_node_t *dummy = queue_node_new(queue, NULL);
+	atomic_init(&queue->head, (uintptr_t)dummy);
+	atomic_init(&queue->tail, (uintptr_t)dummy);
+
+	return (queue);
+}
+
+void
+ll_queue_destroy(ll_queue_t *queue) {
+	assert(queue != NULL);
+
+	/* The retired nodes go back to the pool, the pool takes the rest with it */
+	ll_hp_destroy(queue->hp);
+	ll_pool_destroy(queue->pool);
+	ll_cm_destroy(queue->cm);
+	free(queue);
+}
+
+void
+ll_queue_enqueue(ll_queue_t *queue, void *value) {
+	queue_node_t *node = queue_node_new(queue, value);
+	unsigned int backoff = 0;
+
+	assert(value != NULL);
+
+	for (;;) {
+		queue_node_t *tail = (queue_node_t *)ll_hp_protect(queue->hp, HP_CURR, &queue->tail);
+		uintptr_t next = atomic_load(&tail->next);
+		if (atomic_load(&queue->tail) != (uintptr_t)tail) {
+			continue;
+		}
+		if (next != 0) {
+			/* The tail is lagging behind, help it along */
+			(void)atomic_compare_exchange_strong(&queue->tail, &(uintptr_t){ (uintptr_t)tail }, next);
+			continue;
+		}
+		if (atomic_compare_exchange_strong(&tail->next, &next, (uintptr_t)node)) {
+			(void)atomic_compare_exchange_strong(&queue->tail, &(uintptr_t){ (uintptr_t)tail },
+							     (uintptr_t)node);
+			break;
+		}
+		ll_cm_backoff(queue->cm, &backoff);
+	}
+
+	ll_hp_clear(queue->hp);
+}
+
+void *
+ll_queue_dequeue(ll_queue_t *queue) {
+	unsigned int backoff = 0;
+	void *value = NULL;
+
+	for (;;) {
+		queue_node_t *head = (queue_node_t *)ll_hp_protect(queue->hp, HP_CURR, &queue->head);
+		uintptr_t tail = atomic_load(&queue->tail);
+		queue_node_t *next = (queue_node_t *)ll_hp_protect(queue->hp, HP_NEXT, &head->next);
+		if (atomic_load(&queue->head) != (uintptr_t)head) {
+			continue;
+		}
+		if (next == NULL) {
+			break;
+		}
+		if ((uintptr_t)head == tail) {
+			/* The tail is lagging behind, help it along */
+			(void)atomic_compare_exchange_strong(&queue->tail, &tail, (uintptr_t)next);
+			continue;
+		}
+		/* 'next' becomes the new dummy, its value has to be read before */
+		value = next->value;
+		if (atomic_compare_exchange_strong(&queue->head, &(uintptr_t){ (uintptr_t)head }, (uintptr_t)next)) {
+			ll_hp_clear(queue->hp);
+			ll_hp_retire(queue->hp, (uintptr_t)head);
+			return (value);
+		}
+		ll_cm_backoff(queue->cm, &backoff);
+	}
+
+	ll_hp_clear(queue->hp);
+	return (NULL);
+}
+
+ll_cm_t *
+ll_queue_cm(ll_queue_t *queue) {
+	return (queue->cm);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include "cm.h"
+
+/*%
+ * Lock-free FIFO queue.
+ *
+ * This is the algorithm from Maged M. Michael and Michael L. Scott:
+ * Simple, Fast, and Practical Non-Blocking and Blocking Concurrent Queue
+ * Algorithms, with the nodes reclaimed with hazard pointers as in Maged
+ * M. Michael: Hazard Pointers: Safe Memory Reclamation for Lock-Free
+ * Objects.  An enqueue takes two CASes, a dequeue one.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report an empty queue.
+ */
+
+typedef struct ll_queue ll_queue_t;
+
+ll_queue_t *
+ll_queue_new(void);
+/*%<
+ * Create a new empty queue.
+ */
+
+void
+ll_queue_destroy(ll_queue_t *queue);
+/*%<
+ * Destroy the queue.  No other thread may be using it.  The values still
+ * stored in the queue are not touched.
+ */
+
+void
+ll_queue_enqueue(ll_queue_t *queue, void *value);
+/*%<
+ * Append 'value' to the queue.  'value' must not be NULL.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_queue_dequeue(ll_queue_t *queue);
+/*%<
+ * Remove the oldest value from the queue and return it, or return NULL
+ * if the queue is empty.
+ *
+ * Progress condition: lock-free.
+ */
+
+ll_cm_t *
+ll_queue_cm(ll_queue_t *queue);
+/*%<
+ * Return the contention manager of the queue, it can be used to change
+ * the strategy or to read the number of failed attempts.
+ */
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "cm.h"
+#include "ec.h"
+#include "hp.h"
+#include "ll_deque.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "wsdeque.h"
+
+#define SCHED_SPINS	  64 /* Rounds of looking for work before going to sleep */
+#define SCHED_SYNC_SPINS 1024 /* Rounds of looking for work in sync before yielding */
+
+typedef struct sched_task {
+	ll_sched_func_t *func;
+	void *arg;
+	ll_wait_group_t *wg;
+} sched_task_t;
+
+typedef struct sched_worker {
+	alignas(128) ll_sched_t *sched;
+	ll_wsdeque_t *deque;
+	pthread_t thread;
+	unsigned int id;
+	int cpu; /* -1 when not pinned */
+	uint32_t seed;
+} sched_worker_t;
+
+struct ll_sched {
+	unsigned int nworkers;
+	sched_worker_t *workers;
+	ll_deque_t *inject; /* tasks spawned from outside of the workers */
+	ll_pool_t *tasks;
+	alignas(128) atomic_uint_fast64_t pending; /* spawned, but not picked up yet */
+	atomic_bool stopping;
+	alignas(128) ll_ec_t idle;
+};
+
+static thread_local sched_worker_t *worker_v = NULL;
+
+static inline sched_worker_t *
+sched_self(ll_sched_t *sched) {
+	sched_worker_t *worker = worker_v;
+	return ((worker != NULL && worker->sched == sched) ? worker : NULL);
+}
+
+/* xorshift32, to pick the victims */
+static inline uint32_t
+sched_random(sched_worker_t *worker) {
+	worker->seed ^= worker->seed << 13;
+	worker->seed ^= worker->seed >> 17;
+	worker->seed ^= worker->seed << 5;
+	return (worker->seed);
+}
+
+void
+ll_wait_group_init(ll_wait_group_t *wg) {
+	atomic_init(&wg->count, 0);
+	atomic_init(&wg->notifying, 0);
+	ll_ec_init(&wg->ec);
+}
+
+/*
+ * The waiter may return (and free the wait group) as soon as the count
+ * drops to zero; 'notifying' keeps it around until the last notifier is
+ * done with it.
+ */
+static void
+wait_group_done(ll_wait_group_t *wg) {
+	(void)atomic_fetch_add(&wg->notifying, 1);
+	if (atomic_fetch_sub(&wg->count, 1) == 1) {
+		ll_ec_notify(&wg->ec, INT_MAX);
+	}
+	(void)atomic_fetch_sub_explicit(&wg->notifying, 1, memory_order_release);
+}
+
+/*
+ * Own deque first (the newest task, which is the most likely to be in
+ * the cache), then the tasks from the outside, then the oldest task of
+ * a random victim.
+ */
+static sched_task_t *
+sched_find(ll_sched_t *sched, sched_worker_t *worker) {
+	sched_task_t *task = ll_wsdeque_pop(worker->deque);
+	if (task != NULL) {
+		return (task);
+	}
+
+	task = ll_deque_pop_right(sched->inject);
+	if (task != NULL) {
+		return (task);
+	}
+
+	unsigned int start = sched_random(worker) % sched->nworkers;
+	for (unsigned int i = 0; i < sched->nworkers; i++) {
+		sched_worker_t *victim = &sched->workers[(start + i) % sched->nworkers];
+		if (victim == worker) {
+			continue;
+		}
+		task = ll_wsdeque_steal(victim->deque);
+		if (task != NULL) {
+			return (task);
+		}
+	}
+
+	return (NULL);
+}
+
+static void
+sched_run(ll_sched_t *sched, sched_task_t *task) {
+	(void)atomic_fetch_sub(&sched->pending, 1);
+
+	task->func(task->arg);
+	if (task->wg != NULL) {
+		wait_group_done(task->wg);
+	}
+
+	ll_pool_put(sched->tasks, task);
+}
+
+static void
+sched_pin(sched_worker_t *worker) {
+	cpu_set_t set;
+
+	if (worker->cpu < 0) {
+		return;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(worker->cpu, &set);
+	/* Best effort, the worker runs unpinned when this fails */
+	(void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *
+sched_worker(void *arg) {
+	sched_worker_t *worker = (sched_worker_t *)arg;
+	ll_sched_t *sched = worker->sched;
+	unsigned int spins = 0;
+
+	worker_v = worker;
+	ll_hp_register();
+	sched_pin(worker);
+
+	for (;;) {
+		sched_task_t *task = sched_find(sched, worker);
+		if (task != NULL) {
+			sched_run(sched, task);
+			spins = 0;
+			continue;
+		}
+
+		if (atomic_load(&sched->stopping) && atomic_load(&sched->pending) == 0) {
+			break;
+		}
+
+		if (spins++ < SCHED_SPINS) {
+			ll_cm_pause();
+			continue;
+		}
+
+		unsigned int key = ll_ec_prepare(&sched->idle);
+		if (atomic_load(&sched->pending) > 0 || atomic_load(&sched->stopping)) {
+			ll_ec_cancel(&sched->idle);
+			continue;
+		}
+		ll_ec_wait(&sched->idle, key);
+		spins = 0;
+	}
+
+	return (NULL);
+}
+
+ll_sched_t *
+ll_sched_new(unsigned int nworkers) {
+	ll_sched_t *sched = aligned_alloc(128, sizeof(*sched));
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE];
+	int ncpus = 0;
+
+	assert(sched != NULL);
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &allowed)) {
+				cpus[ncpus++] = cpu;
+			}
+		}
+	}
+
+	if (nworkers == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		nworkers = (ncpus > 0) ? (unsigned int)ncpus : (online > 0) ? (unsigned int)online : 1;
+	}
+
+	*sched = (ll_sched_t){
+		.nworkers = nworkers,
+		.inject = ll_deque_new(LL_DEQUE_HP),
+		.tasks = ll_pool_new(sizeof(sched_task_t), alignof(sched_task_t), offsetof(sched_task_t, func), 0),
+	};
+	atomic_init(&sched->pending, 0);
+	atomic_init(&sched->stopping, false);
+	ll_ec_init(&sched->idle);
+
+	sched->workers = aligned_alloc(128, nworkers * sizeof(sched->workers[0]));
+	assert(sched->workers != NULL);
+
+	for (unsigned int i = 0; i < nworkers; i++) {
+		sched->workers[i] = (sched_worker_t){
+			.sched = sched,
+			.deque = ll_wsdeque_new(0),
+			.id = i,
+			/* Pin only when every worker gets a CPU of its own */
+			.cpu = (nworkers <= (unsigned int)ncpus) ? cpus[i] : -1,
+			.seed = 2463534242U + i,
+		};
+	}
+	for (unsigned int i = 0; i < nworkers; i++) {
+		int r = pthread_create(&sched->workers[i].thread, NULL, sched_worker, &sched->workers[i]);
+		assert(r == 0);
+		(void)r;
+	}
+
+	return (sched);
+}
+
+void
+ll_sched_destroy(ll_sched_t *sched) {
+	assert(sched != NULL);
+	assert(sched_self(sched) == NULL);
+
+	atomic_store(&sched->stopping, true);
+	ll_ec_notify(&sched->idle, INT_MAX);
+
+	for (unsigned int i = 0; i < sched->nworkers; i++) {
+		pthread_join(sched->workers[i].thread, NULL);
+	}
+	for (unsigned int i = 0; i < sched->nworkers; i++) {
+		ll_wsdeque_destroy(sched->workers[i].deque);
+	}
+
+	free(sched->workers);
+	ll_deque_destroy(sched->inject);
+	ll_pool_destroy(sched->tasks);
+	free(sched);
+}
+
+void
+ll_sched_spawn(ll_sched_t *sched, ll_wait_group_t *wg, ll_sched_func_t *func, void *arg) {
+	sched_worker_t *worker = sched_self(sched);
+	sched_task_t *task = ll_pool_get(sched->tasks);
+
+	*task = (sched_task_t){ .func = func, .arg = arg, .wg = wg };
+	if (wg != NULL) {
+		(void)atomic_fetch_add(&wg->count, 1);
+	}
+	(void)atomic_fetch_add(&sched->pending, 1);
+
+	if (worker != NULL) {
+		ll_wsdeque_push(worker->deque, task);
+	} else {
+		ll_deque_push_left(sched->inject, task);
+	}
+
+	ll_ec_notify(&sched->idle, 1);
+}
+
+void
+ll_sched_sync(ll_sched_t *sched, ll_wait_group_t *wg) {
+	sched_worker_t *worker = sched_self(sched);
+
+	if (worker != NULL) {
+		/* Help instead of blocking the worker */
+		unsigned int spins = 0;
+		while (atomic_load(&wg->count) > 0) {
+			sched_task_t *task = sched_find(sched, worker);
+			if (task != NULL) {
+				sched_run(sched, task);
+				spins = 0;
+			} else if (spins++ < SCHED_SYNC_SPINS) {
+				ll_cm_pause();
+			} else {
+				(void)sched_yield();
+			}
+		}
+	} else {
+		while (atomic_load(&wg->count) > 0) {
+			unsigned int key = ll_ec_prepare(&wg->ec);
+			if (atomic_load(&wg->count) == 0) {
+				ll_ec_cancel(&wg->ec);
+				break;
+			}
+			ll_ec_wait(&wg->ec, key);
+		}
+	}
+
+	while (atomic_load_explicit(&wg->notifying, memory_order_acquire) > 0) {
+		ll_cm_pause();
+	}
+}
+
+unsigned int
+ll_sched_workers(ll_sched_t *sched) {
+	return (sched->nworkers);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "ec.h"
+
+/*%
+ * Work-stealing task scheduler.
+ *
+ * The scheduler runs a fixed pool of worker threads, each pinned to its
+ * own CPU (when there are enough of them) and owning a work-stealing
+ * deque.  A task spawned by a worker goes to the worker's own deque and
+ * is normally run by the same worker, most recently spawned first, so
+ * it runs on the core whose cache holds its data.  Idle workers steal
+ * the oldest task from a randomly chosen victim, and workers that find
+ * nothing to do sleep on a futex until new work arrives.  Tasks spawned
+ * from other threads go through a shared lock-free deque.
+ */
+
+typedef struct ll_sched ll_sched_t;
+
+typedef void(ll_sched_func_t)(void *arg);
+
+typedef struct ll_wait_group {
+	atomic_uint count;
+	atomic_uint notifying;
+	ll_ec_t ec;
+} ll_wait_group_t;
+/*%<
+ * A wait group counts the tasks that have been spawned into it and have
+ * not finished yet.
+ */
+
+void
+ll_wait_group_init(ll_wait_group_t *wg);
+/*%<
+ * Initialize the wait group.
+ */
+
+ll_sched_t *
+ll_sched_new(unsigned int nworkers);
+/*%<
+ * Create a new scheduler with 'nworkers' worker threads (or one per
+ * online CPU if 'nworkers' is 0).
+ */
+
+void
+ll_sched_destroy(ll_sched_t *sched);
+/*%<
+ * Wait until all the spawned tasks have been run, stop the workers and
+ * destroy the scheduler.
+ */
+
+void
+ll_sched_spawn(ll_sched_t *sched, ll_wait_group_t *wg, ll_sched_func_t *func, void *arg);
+/*%<
+ * Schedule 'func(arg)' to run on one of the workers.  If 'wg' is not
+ * NULL, the task is counted in the wait group until it finishes.  Can
+ * be called from any thread, including from within a task.
+ *
+ * Progress condition: lock-free.
+ */
+
+void
+ll_sched_sync(ll_sched_t *sched, ll_wait_group_t *wg);
+/*%<
+ * Wait until all the tasks spawned into 'wg' have finished.  When called
+ * from a task, the worker keeps running other tasks meanwhile, so tasks
+ * can spawn and sync recursively; any other thread sleeps.
+ */
+
+unsigned int
+ll_sched_workers(ll_sched_t *sched);
+/*%<
+ * Return the number of worker threads.
+ */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc.h"
+
+/*
+ * The indices run freely and are masked on access.  'tail' and 'head_cache'
+ * belong to the producer, 'head' and 'tail_cache' to the consumer; the
+ * read-only geometry sits on a line of its own.
+ */
+struct ll_spsc {
+	alignas(128) atomic_size_t tail;
+	size_t head_cache;
+	alignas(128) atomic_size_t head;
+	size_t tail_cache;
+	alignas(128) size_t mask;
+	size_t size;
+	size_t stride;
+	unsigned char *slots;
+};
+
+#define spsc_slot(r, i) ((void *)((r)->slots + ((i) & (r)->mask) * (r)->stride))
+
+ll_spsc_t *
+ll_spsc_new(size_t capacity, size_t size) {
+	ll_spsc_t *ring = aligned_alloc(128, sizeof(*ring));
+	size_t n = 1;
+
+	assert(ring != NULL);
+	assert(capacity > 0);
+	assert(size > 0);
+
+	while (n < capacity) {
+		n <<= 1;
+	}
+
+	atomic_init(&ring->tail, 0);
+	ring->head_cache = 0;
+	atomic_init(&ring->head, 0);
+	ring->tail_cache = 0;
+	ring->mask = n - 1;
+	ring->size = size;
+	ring->stride = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+	ring->slots = aligned_alloc(128, (n * ring->stride + 127) & ~(size_t)127);
+	assert(ring->slots != NULL);
+
+	return (ring);
+}
+
+void
+ll_spsc_destroy(ll_spsc_t *ring) {
+	assert(ring != NULL);
+
+	free(ring->slots);
+	free(ring);
+}
+
+void *
+ll_spsc_reserve(ll_spsc_t *ring) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (tail - ring->head_cache > ring->mask) {
+		ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if (tail - ring->head_cache > ring->mask) {
+			return (NULL);
+		}
+	}
+
+	return (spsc_slot(ring, tail));
+}
+
+void
+ll_spsc_commit(ll_spsc_t *ring) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	assert(tail - ring->head_cache <= ring->mask);
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void *
+ll_spsc_peek(ll_spsc_t *ring) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	if (head == ring->tail_cache) {
+		ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		if (head == ring->tail_cache) {
+			return (NULL);
+		}
+	}
+
+	return (spsc_slot(ring, head));
+}
+
+void
+ll_spsc_release(ll_spsc_t *ring) {
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	assert(head != ring->tail_cache);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool
+ll_spsc_push(ll_spsc_t *ring, const void *item) {
+	void *slot = ll_spsc_reserve(ring);
+	if (slot == NULL) {
+		return (false);
+	}
+
+	memmove(slot, item, ring->size);
+	ll_spsc_commit(ring);
+
+	return (true);
+}
+
+bool
+ll_spsc_pop(ll_spsc_t *ring, void *item) {
+	void *slot = ll_spsc_peek(ring);
+	if (slot == NULL) {
+		return (false);
+	}
+
+	memmove(item, slot, ring->size);
+	ll_spsc_release(ring);
+
+	return (true);
+}
+
+size_t
+ll_spsc_size(ll_spsc_t *ring) {
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	return ((tail > head) ? tail - head : 0);
+}
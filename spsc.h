@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*%
+ * Bounded single-producer single-consumer ring.
+ *
+ * The ring holds a fixed number of fixed-size slots.  The producer and
+ * the consumer each own one index on its own cache line, and each keeps a
+ * private copy of the other's index, which is refreshed only when the
+ * ring looks full (or empty); most operations touch no shared cache line
+ * other than the slot itself.
+ *
+ * The producer writes the item in place between ll_spsc_reserve() and
+ * ll_spsc_commit(), and the consumer reads it in place between
+ * ll_spsc_peek() and ll_spsc_release(), so there is no copy and no
+ * allocation per item.  ll_spsc_push() and ll_spsc_pop() are the copying
+ * shortcuts.
+ *
+ * Exactly one thread may act as the producer and one as the consumer.
+ */
+
+typedef struct ll_spsc ll_spsc_t;
+
+ll_spsc_t *
+ll_spsc_new(size_t capacity, size_t size);
+/*%<
+ * Create a new ring with room for 'capacity' items of 'size' bytes.  The
+ * capacity is rounded up to a power of two.
+ */
+
+void
+ll_spsc_destroy(ll_spsc_t *ring);
+/*%<
+ * Destroy the ring.  Neither the producer nor the consumer may be using
+ * it.
+ */
+
+void *
+ll_spsc_reserve(ll_spsc_t *ring);
+/*%<
+ * Return the next free slot, or NULL if the ring is full.  The consumer
+ * does not see the slot until ll_spsc_commit() is called; reserving again
+ * before that returns the same slot.  Producer only.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void
+ll_spsc_commit(ll_spsc_t *ring);
+/*%<
+ * Hand the slot returned by ll_spsc_reserve() over to the consumer.
+ * Producer only.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void *
+ll_spsc_peek(ll_spsc_t *ring);
+/*%<
+ * Return the oldest committed slot, or NULL if the ring is empty.  The
+ * slot stays in the ring until ll_spsc_release() is called.  Consumer
+ * only.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void
+ll_spsc_release(ll_spsc_t *ring);
+/*%<
+ * Give the slot returned by ll_spsc_peek() back to the producer.
+ * Consumer only.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+bool
+ll_spsc_push(ll_spsc_t *ring, const void *item);
+/*%<
+ * Copy 'item' into the ring.  Returns false if the ring is full.
+ * Producer only.
+ */
+
+bool
+ll_spsc_pop(ll_spsc_t *ring, void *item);
+/*%<
+ * Copy the oldest item out of the ring into 'item'.  Returns false if the
+ * ring is empty.  Consumer only.
+ */
+
+size_t
+ll_spsc_size(ll_spsc_t *ring);
+/*%<
+ * Return the number of committed items in the ring.  The value is only a
+ * hint when the other side is using the ring.
+ */
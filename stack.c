@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "cm.h"
+#include "elim.h"
+#include "hp.h"
+#include "pool.h"
+#include "stack.h"
+
+#define HP_TOP 0
+
+typedef struct stack_node {
+	uintptr_t next;
+	void *value;
+	struct ll_stack *stack;
+} stack_node_t;
+
+struct ll_stack {
+	alignas(128) atomic_uintptr_t top;
+	alignas(128) ll_hp_t *hp;
+	ll_cm_t *cm;
+	ll_pool_t *pool;
+	ll_elim_t *elim; /* LL_STACK_ELIMINATION only */
+};
+
+static void
+stack_node_delete(void *arg) {
+	stack_node_t *node = (stack_node_t *)arg;
+	ll_pool_put(node->stack->pool, node);
+}
+
+ll_stack_t *
+ll_stack_new(unsigned int flags) {
+	ll_stack_t *stack = aligned_alloc(128, sizeof(*stack));
+	assert(stack != NULL);
+
+	atomic_init(&stack->top, 0);
+	stack->hp = ll_hp_new(1, stack_node_delete);
+	stack->cm = ll_cm_new(LL_CM_BACKOFF, 0, 0);
+	stack->pool = ll_pool_new(sizeof(stack_node_t), alignof(stack_node_t), offsetof(stack_node_t, value), 0);
+	stack->elim = ((flags & LL_STACK_ELIMINATION) != 0) ? ll_elim_new() : NULL;
+
+	return (stack);
+}
+
+void
+ll_stack_destroy(ll_stack_t *stack) {
+	assert(stack != NULL);
+
+	/* The retired nodes go back to the pool, the pool takes the rest with it */
+	ll_hp_destroy(stack->hp);
+	ll_pool_destroy(stack->pool);
+	ll_cm_destroy(stack->cm);
+	if (stack->elim != NULL) {
+		ll_elim_destroy(stack->elim);
+	}
+	free(stack);
+}
+
+void
+ll_stack_push(ll_stack_t *stack, void *value) {
+	stack_node_t *node = ll_pool_get(stack->pool);
+	unsigned int backoff = 0;
+
+	assert(value != NULL);
+
+	node->value = value;
+	node->stack = stack;
+
+	for (;;) {
+		uintptr_t top = atomic_load_explicit(&stack->top, memory_order_relaxed);
+		node->next = top;
+		if (atomic_compare_exchange_strong_explicit(&stack->top, &top, (uintptr_t)node, memory_order_release,
+							    memory_order_relaxed)) {
+			return;
+		}
+		if (stack->elim != NULL && ll_elim_push(stack->elim, value)) {
+			/* Nobody has seen the node */
+			ll_pool_put(stack->pool, node);
+			return;
+		}
+		ll_cm_backoff(stack->cm, &backoff);
+	}
+}
+
+void *
+ll_stack_pop(ll_stack_t *stack) {
+	unsigned int backoff = 0;
+	void *value = NULL;
+
+	for (;;) {
+		stack_node_t *top = (stack_node_t *)ll_hp_protect(stack->hp, HP_TOP, &stack->top);
+		if (top == NULL) {
+			break;
+		}
+		/* The hazard pointer keeps 'top' from being reused, so 'next' cannot be stale when the CAS succeeds */
+		if (atomic_compare_exchange_strong(&stack->top, &(uintptr_t){ (uintptr_t)top }, top->next)) {
+			value = top->value;
+			ll_hp_clear(stack->hp);
+			ll_hp_retire(stack->hp, (uintptr_t)top);
+			return (value);
+		}
+		if (stack->elim != NULL && (value = ll_elim_pop(stack->elim)) != NULL) {
+			break;
+		}
+		ll_cm_backoff(stack->cm, &backoff);
+	}
+
+	ll_hp_clear(stack->hp);
+	return (value);
+}
+
+ll_cm_t *
+ll_stack_cm(ll_stack_t *stack) {
+	return (stack->cm);
+}
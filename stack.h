@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include "cm.h"
+
+/*%
+ * Lock-free LIFO stack.
+ *
+ * This is the stack from R. Kent Treiber: Systems Programming: Coping
+ * with Parallelism, with the nodes reclaimed with hazard pointers, which
+ * also rules out the ABA problem on the top of the stack.  A push and a
+ * pop take a single CAS each.
+ *
+ * With LL_STACK_ELIMINATION a push and a pop whose CASes failed try to
+ * meet in an elimination array (see elim.h) before they retry, which
+ * keeps the stack scaling when many threads hammer its top.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report an empty stack.
+ */
+
+typedef struct ll_stack ll_stack_t;
+
+enum {
+	LL_STACK_ELIMINATION = 1 << 0, /*%< Pair colliding pushes and pops */
+};
+
+ll_stack_t *
+ll_stack_new(unsigned int flags);
+/*%<
+ * Create a new empty stack.
+ */
+
+void
+ll_stack_destroy(ll_stack_t *stack);
+/*%<
+ * Destroy the stack.  No other thread may be using it.  The values still
+ * stored in the stack are not touched.
+ */
+
+void
+ll_stack_push(ll_stack_t *stack, void *value);
+/*%<
+ * Push 'value' on the top of the stack.  'value' must not be NULL.
+ *
+ * Progress condition: lock-free.
+ */
+
+void *
+ll_stack_pop(ll_stack_t *stack);
+/*%<
+ * Pop the value from the top of the stack, or return NULL if the stack
+ * is empty.
+ *
+ * Progress condition: lock-free.
+ */
+
+ll_cm_t *
+ll_stack_cm(ll_stack_t *stack);
+/*%<
+ * Return the contention manager of the stack, it can be used to change
+ * the strategy or to read the number of failed attempts.
+ */
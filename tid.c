@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "tid.h"
+
+static atomic_int_fast32_t tid_v_base = ATOMIC_VAR_INIT(0);
+
+thread_local int ll__tid_v = LL__TID_UNKNOWN;
+
+int
+ll__tid_assign(void) {
+	ll__tid_v = atomic_fetch_add(&tid_v_base, 1);
+	assert(ll__tid_v < LL_TID_MAX);
+
+	return (ll__tid_v);
+}
+
+int
+ll_tid_count(void) {
+	int count = atomic_load(&tid_v_base);
+
+	return ((count < LL_TID_MAX) ? count : LL_TID_MAX);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <threads.h>
+
+/*%
+ * Thread ids, internal to the library.
+ *
+ * Every thread that uses one of the structures is given a small id the
+ * first time it asks for one, and keeps it until it exits; the modules
+ * use it to index their per-thread slots.  The ids are shared by all the
+ * modules and are not reused, so at most LL_TID_MAX threads may use the
+ * library over the life of the process.
+ */
+
+#define LL_TID_MAX 128 /*%< ids handed out, and the per-thread slots of every module */
+
+#define LL__TID_UNKNOWN -1
+
+extern thread_local int ll__tid_v;
+
+int
+ll__tid_assign(void);
+
+static inline int
+ll_tid(void) {
+	if (ll__tid_v == LL__TID_UNKNOWN) {
+		return (ll__tid_assign());
+	}
+
+	return (ll__tid_v);
+}
+/*%<
+ * Return the id of the calling thread, from 0 to LL_TID_MAX - 1.
+ */
+
+int
+ll_tid_count(void);
+/*%<
+ * Return the number of ids handed out so far: only the threads below it
+ * can have written to a per-thread slot, the scans need not look any
+ * further.
+ */
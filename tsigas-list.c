@@ -1,15 +1,24 @@
 #include <assert.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-
-#define NELEMENTS 4096
-#define NTHREADS 4
+#include <threads.h>
+#include <time.h>
+
+#include "cm.h"
+#include "ec.h"
+#include "elim.h"
+#include "fc.h"
+#include "hp.h"
+#include "ll_deque.h"
+#include "pool.h"
+#include "tid.h"
 
 typedef atomic_uintptr_t link_t;
 
@@ -19,37 +28,83 @@ typedef atomic_uintptr_t link_t;
 
 #define is_claimed(n) (bool)(((uintptr_t)(n)->refct_claim & 0x01) == 0x01)
 
+typedef enum {
+	LL_RECLAIM_REFCOUNT, /* Valois, Michael and Scott reference counting */
+	LL_RECLAIM_HP,	     /* hazard pointers for local references, counts for links */
+	LL_RECLAIM_NONE,     /* the nodes are never reclaimed, a baseline for the other two */
+} ll_reclaim_t;
+
+/* Nodes taken out of the deque and nodes put back to the pool, written by their owner only */
+typedef struct deque_counter {
+	alignas(128) atomic_uint_fast64_t removed;
+	atomic_uint_fast64_t reclaimed;
+} deque_counter_t;
+
 typedef struct Node {
 	atomic_uint_fast32_t refct_claim;
 	void *value;
+	struct ll_deque *list;
+	atomic_uint_fast32_t gen;  /* LL_RECLAIM_HP only */
+	uint_fast32_t retire_gen;  /* LL_RECLAIM_HP only */
 	alignas(64) link_t prev, next; /* Should be aligned to cache pipeline size */
 } node_t;
 
-typedef struct List {
-	node_t heads, tails;
-	node_t *head, *tail;
+/*
+ * The sentinels are embedded in the deque, every thread touches them on every operation, so keep them away from each
+ * other and from the read-mostly fields.
+ */
+typedef struct ll_deque {
+	alignas(128) node_t head;
+	alignas(128) node_t tail;
+	alignas(128) ll_cm_t *cm;
+	ll_fc_t *fc;
+	ll_reclaim_t reclaim;
+	ll_hp_t *hp;
+	ll_pool_t *pool;
+	bool destroying;
+	ll_elim_t *elim_left;  /* LL_DEQUE_ELIMINATION only */
+	ll_elim_t *elim_right; /* LL_DEQUE_ELIMINATION only */
+	alignas(128) ll_ec_t ec; /* consumers waiting for the deque to become non-empty */
+	deque_counter_t counters[LL_TID_MAX];
 } list_t;
 
-node_t *head, *tail;
+static inline void
+CountNodes(atomic_uint_fast64_t *counter, size_t n) {
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
 
-#if defined(NDEBUG)
-#define pnode(name, node, file, line)
-#else
+/* The nodes are out of the deque, they wait to be reclaimed from now on */
+static inline void
+RemovedNodes(list_t *list, size_t n) {
+	CountNodes(&list->counters[ll_tid()].removed, n);
+}
+
+static inline void
+FreeNode(list_t *list, node_t *node) {
+	CountNodes(&list->counters[ll_tid()].reclaimed, 1);
+	ll_pool_put(list->pool, node);
+}
+
+/* Every node operation is traced to stderr with -DLL_DEQUE_TRACE, assertions alone do not turn it on */
+#if defined(LL_DEQUE_TRACE)
 #define pnode(name, node, file, line) _pnode(name, node, file, line)
+#else
+#define pnode(name, node, file, line) ((void)(file), (void)(line))
 #endif
 
-char *
+static char *
 X(char *buf, size_t len, node_t *node0) {
 	bool deleted = is_marked(node0);
 	node_t *node = (node_t *)get_unmarked(node0);
+	list_t *list = (node != NULL) ? node->list : NULL;
 	if (deleted) {
 		*buf = '*';
 		buf++;
 		len--;
 	}
-	if (node == head) {
+	if (list != NULL && node == &list->head) {
 		snprintf(buf, len, "HEAD");
-	} else if (node == tail) {
+	} else if (list != NULL && node == &list->tail) {
 		snprintf(buf, len, "TAIL");
 	} else {
 		snprintf(buf, len, "%p", node);
@@ -81,15 +136,6 @@ __attribute__((unused)) static void _pnode(char *name, node_t *node, char *file,
 /* function COPY_NODE(node:pointer to Node):pointer to Node */
 /* procedure RELEASE_NODE(node:pointer to Node) */
 
-#if defined(NDEBUG) || 1
-#define CheckConsistency(list) true
-#else
-#define CheckConsistency(list) _CheckConsistency(list)
-#endif
-
-__attribute__((unused)) static bool
-_CheckConsistency(list_t *list);
-
 /* Valois, Michael, Scott: Memory Management */
 
 __attribute__((unused)) static void
@@ -97,27 +143,176 @@ ClearLowestBit(atomic_uint_fast32_t *ptr) {
 	uint_fast32_t new = 0;
 	uint_fast32_t old = atomic_load(ptr);
 	do {
-		new = old - 1;
+		new = old & ~(uint_fast32_t)0x01;
 	} while (!atomic_compare_exchange_weak(ptr, &old, new));
 }
 
+/*
+ * Hazard Pointers with link counts, after Gidenstam, Papatriantafilou, Sundell and Tsigas: Efficient and Reliable
+ * Lock-Free Memory Reclamation Based on Reference Counting.
+ *
+ * Local references (READ_NODE, READ_DEL_NODE, COPY_NODE, RELEASE_NODE) are hazard pointers and never write to the
+ * node.  Only references stored in other nodes' links are counted in refct_claim (LINK_NODE, UNLINK_NODE).  When the
+ * last link goes away the node is retired through ll_hp_retire() with the lowest bit of refct_claim set, and it is
+ * freed once no hazard pointer protects it.
+ *
+ * A thread that still holds a local reference to a retired node can link it again.  Every link bumps the node
+ * generation; a node whose generation changed since it was retired is not freed, it gets retired again when its last
+ * link goes away.
+ */
+
+#define HP_MAX_LOCAL 12 /* Local references held by a thread at the same time */
+
+static thread_local uintptr_t hp_local_v[HP_MAX_LOCAL];
+
+static void
+HPDeleteNode(void *arg);
+
+static inline int
+HPSlot(void) {
+	for (int i = 0; i < HP_MAX_LOCAL; i++) {
+		if (hp_local_v[i] == 0) {
+			return (i);
+		}
+	}
+	assert(0);
+	return (-1);
+}
+
+static node_t *
+HPReadNode(list_t *list, link_t *address, bool allow_marked) {
+	int ihp = HPSlot();
+	for (;;) {
+		uintptr_t link = atomic_load(address);
+		node_t *node = (node_t *)get_unmarked(link);
+		assert(node != NULL);
+		(void)ll_hp_protect_ptr(list->hp, ihp, (uintptr_t)node);
+
+		/* The underlying address has not changed meanwhile */
+		if (link == atomic_load(address)) {
+			if (!allow_marked && is_marked(link)) {
+				ll_hp_clear_one(list->hp, ihp);
+				return NULL;
+			}
+			hp_local_v[ihp] = (uintptr_t)node;
+			return node;
+		}
+	}
+}
+
+static node_t *
+HPCopyNode(list_t *list, node_t *node) {
+	int ihp = HPSlot();
+	(void)ll_hp_protect_ptr(list->hp, ihp, (uintptr_t)node);
+	hp_local_v[ihp] = (uintptr_t)node;
+	return node;
+}
+
+static void
+HPReleaseNode(list_t *list, node_t *node) {
+	for (int i = HP_MAX_LOCAL - 1; i >= 0; i--) {
+		if (hp_local_v[i] == (uintptr_t)node) {
+			hp_local_v[i] = 0;
+			ll_hp_clear_one(list->hp, i);
+			return;
+		}
+	}
+	assert(0);
+}
+
+static void
+HPLinkNode(node_t *node) {
+	(void)atomic_fetch_add(&node->gen, 1);
+	(void)atomic_fetch_add(&node->refct_claim, 2);
+}
+
+static void
+HPRetireNode(list_t *list, node_t *node) {
+	uint_fast32_t gen = atomic_load(&node->gen);
+	uint_fast32_t zero = 0;
+
+	/* Retire only once, the lowest bit is set while the node sits in a retire list */
+	if (!atomic_compare_exchange_strong(&node->refct_claim, &zero, 1)) {
+		return;
+	}
+	node->retire_gen = gen;
+	ll_hp_retire(list->hp, (uintptr_t)node);
+}
+
+static void
+HPUnlinkNode(list_t *list, node_t *node) {
+	uint_fast32_t old = atomic_fetch_sub(&node->refct_claim, 2);
+	assert(old >= 2);
+	if (old == 2) {
+		HPRetireNode(list, node);
+	}
+}
+
+/* The delete function called by ll_hp_retire() when no hazard pointer protects the node */
+static void
+HPDeleteNode(void *arg) {
+	node_t *node = (node_t *)arg;
+	list_t *list = node->list;
+
+	/*
+	 * The whole pool goes away with the deque, following the links from here would only recurse along the chains of
+	 * retired nodes.
+	 */
+	if (list->destroying) {
+		return;
+	}
+
+	if (atomic_load(&node->refct_claim) == 1 && atomic_load(&node->gen) == node->retire_gen) {
+		node_t *prev = (node_t *)get_unmarked(atomic_load(&node->prev));
+		node_t *next = (node_t *)get_unmarked(atomic_load(&node->next));
+		/* A discarded node has never been linked in */
+		if (prev != NULL) {
+			HPUnlinkNode(list, prev);
+		}
+		if (next != NULL) {
+			HPUnlinkNode(list, next);
+		}
+		FreeNode(list, node);
+		return;
+	}
+
+	/* The node has been linked again, give up the retirement */
+	(void)atomic_fetch_and(&node->refct_claim, ~(uint_fast32_t)1);
+	if (atomic_load(&node->refct_claim) == 0) {
+		HPRetireNode(list, node);
+	}
+}
+
 /* That would be NEW() in Michael&Scott's paper */
 /*
  * The function MALLOC_NODE allocates a new node from the memory pool of pre-allocated nodes.
+ *
+ * The pool is type-stable, a node that sits in the pool is still a node, and other threads might be incrementing and
+ * decrementing its reference counter.  A free node is claimed (the lowest bit is set, or it is zero when it has never
+ * been used), so the counter must never be reset, only the claim is dropped.
  */
 static node_t *
-_MALLOC_NODE(char *file, unsigned int line) {
-	node_t *p = aligned_alloc(sizeof(void *), sizeof(*p));
-	assert(p != NULL);
-	*p = (node_t){ .refct_claim = ATOMIC_VAR_INIT(0) };
-	/* atomic_init(&p->refct_claim, 3); */
-	/* ClearLowestBit(&p->refct_claim); */
+_MALLOC_NODE(list_t *list, char *file, unsigned int line) {
+	node_t *p = ll_pool_get(list->pool);
+	p->value = NULL;
+	p->list = list;
+	atomic_store(&p->prev, 0);
+	atomic_store(&p->next, 0);
+	/* The caller holds the first local reference */
+	if (list->reclaim == LL_RECLAIM_HP) {
+		atomic_store(&p->refct_claim, 0);
+		atomic_store(&p->gen, 0);
+		(void)HPCopyNode(list, p);
+	} else if (list->reclaim == LL_RECLAIM_REFCOUNT) {
+		(void)atomic_fetch_add(&p->refct_claim, 2);
+		ClearLowestBit(&p->refct_claim);
+	}
 	/* Must not be claimed */
 	pnode("MALLOC_NODE", p, file, line);
 	return p;
 }
 
-#define MALLOC_NODE() _MALLOC_NODE(__FILE__, __LINE__)
+#define MALLOC_NODE(l) _MALLOC_NODE(l, __FILE__, __LINE__)
 
 /*
  * old = 5; new = 3; old - new = 2; result = 0
@@ -142,32 +337,56 @@ DecrementAndTestAndSet(atomic_uint_fast32_t *ptr) {
 	return ((old - new) & 0x01) == 0x01;
 }
 
-void
-ReleaseReferences(node_t *node);
+static void
+ReleaseReferences(list_t *list, node_t *node);
+
+/* The nodes of the thread whose counter dropped to zero, linked through their value, see RELEASE_NODE */
+static thread_local node_t *release_list_v;
+static thread_local bool releasing_v;
 
 /* That would be RELEASE in the paper */
 /*
  * The function RELEASE_NODE decrements the reference counter on the corresponding give node. If the reference counter
- * reaches zero, the function the calls the ReleaseReferences function that will recursively call RELEASE_NODE on the
- * nodes that this node has owned pointers to, and the it reclaims the node.
+ * reaches zero, the function the calls the ReleaseReferences function that will call RELEASE_NODE on the nodes that this
+ * node has owned pointers to, and the it reclaims the node.
 */
 static void
-_RELEASE_NODE(node_t *node, char *file, unsigned int line) {
+_RELEASE_NODE(list_t *list, node_t *node, char *file, unsigned int line) {
 	assert(node != NULL);
 	pnode("RELEASE_NODE", node, file, line);
 	assert(!is_marked(node));
-	assert(!is_claimed(node));
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPReleaseNode(list, node);
+		return;
+	}
+	if (list->reclaim == LL_RECLAIM_NONE) {
+		return;
+	}
 	if (DecrementAndTestAndSet(&node->refct_claim) == false) {
 		return;
 	}
 	/* MUST BE CLAIMED */
 	assert(is_claimed(node));
-	ReleaseReferences(node);
-	memset(node, 0, sizeof(*node));
-	free(node);
+
+	/*
+	 * The deleted nodes link to each other and a long chain of them can be freed at once, so the nodes are queued
+	 * and the outermost RELEASE_NODE of the thread frees them in a loop instead of recursing along the chain.
+	 */
+	node->value = release_list_v;
+	release_list_v = node;
+	if (releasing_v) {
+		return;
+	}
+	releasing_v = true;
+	while ((node = release_list_v) != NULL) {
+		release_list_v = node->value;
+		ReleaseReferences(list, node);
+		FreeNode(list, node);
+	}
+	releasing_v = false;
 }
 
-#define RELEASE_NODE(n) _RELEASE_NODE(n, __FILE__, __LINE__)
+#define RELEASE_NODE(l, n) _RELEASE_NODE(l, n, __FILE__, __LINE__)
 
 /* That would be SAFEREAD() in Michael&Scott's paper */
 /*
@@ -175,65 +394,138 @@ _RELEASE_NODE(node_t *node, char *file, unsigned int line) {
  * for the corresponding node. In case the deletion mark of the link is set, the READ_NODE function then returns NULL.
  */
 static node_t *
-__READ_NODE(link_t *address, bool allow_marked, char *file, unsigned int line) {
+__READ_NODE(list_t *list, link_t *address, bool allow_marked, char *file, unsigned int line) {
+	(void)file;
+	(void)line;
+
+	if (list->reclaim == LL_RECLAIM_HP) {
+		return HPReadNode(list, address, allow_marked);
+	}
+	if (list->reclaim == LL_RECLAIM_NONE) {
+		link_t link = atomic_load(address);
+		assert(get_unmarked(link) != 0);
+		return ((!allow_marked && is_marked(link)) ? NULL : (node_t *)get_unmarked(link));
+	}
 	for (;;) {
 		link_t link = atomic_load(address);
 		node_t *node = (node_t *)get_unmarked(link);
 		assert(node != NULL);
-		assert(!is_claimed(node));
+		/* The node might have been freed meanwhile, the pool keeps it a node */
 		atomic_fetch_add(&node->refct_claim, 2);
 
 		/* The underlying address has not changed meanwhile */
 		if (link == atomic_load(address)) {
 			if (!allow_marked && is_marked(link)) {
+				RELEASE_NODE(list, node);
 				return NULL;
 			}
 			return node;
 		}
 		/* If it did, release the node and retry */
-		RELEASE_NODE(node);
+		RELEASE_NODE(list, node);
 	}
 }
 
 static inline node_t *
-_READ_NODE(link_t *address, char *file, unsigned int line) {
+_READ_NODE(list_t *list, link_t *address, char *file, unsigned int line) {
 	pnode("READ_NODE", (node_t *)*address, file, line);
 
-	return __READ_NODE(address, false, file, line);
+	return __READ_NODE(list, address, false, file, line);
 }
 
 static inline node_t *
-_READ_DEL_NODE(link_t *address, char *file, unsigned int line) {
+_READ_DEL_NODE(list_t *list, link_t *address, char *file, unsigned int line) {
 	pnode("READ_DEL_NODE", (node_t *)*address, file, line);
 
-	return __READ_NODE(address, true, file, line);
+	return __READ_NODE(list, address, true, file, line);
 }
 
-#define READ_NODE(a) _READ_NODE(a, __FILE__, __LINE__)
-#define READ_DEL_NODE(a) _READ_DEL_NODE(a, __FILE__, __LINE__)
+#define READ_NODE(l, a) _READ_NODE(l, a, __FILE__, __LINE__)
+#define READ_DEL_NODE(l, a) _READ_DEL_NODE(l, a, __FILE__, __LINE__)
 
 /*
  * The COPY_NODE function increases the reference counter for the corresponding given node.
  */
 static node_t *
-_COPY_NODE(node_t *node, char *file, unsigned int line) {
+_COPY_NODE(list_t *list, node_t *node, char *file, unsigned int line) {
 	pnode("COPY_NODE", node, file, line);
 	assert(!is_marked(node));
+	if (list->reclaim == LL_RECLAIM_HP) {
+		return HPCopyNode(list, node);
+	}
+	if (list->reclaim == LL_RECLAIM_NONE) {
+		return (node);
+	}
 	assert(!is_claimed(node));
 	atomic_fetch_add(&node->refct_claim, 2);
 	return (node);
 }
 
-#define COPY_NODE(n) _COPY_NODE(n, __FILE__, __LINE__)
+#define COPY_NODE(l, n) _COPY_NODE(l, n, __FILE__, __LINE__)
+
+/*
+ * The paper uses COPY_NODE and RELEASE_NODE for the references held in links as well.  With hazard pointers these
+ * are different: LINK_NODE counts a reference that is about to be stored into a link, UNLINK_NODE drops a reference
+ * that has been removed from a link (or that failed to be stored), and ADOPT_NODE turns a local reference into a
+ * link reference: it counts the link before the store, ADOPTED_NODE drops the local reference once the link is in
+ * place and UNADOPT_NODE drops the count again when the CAS failed.  With reference counts the local reference simply
+ * becomes the link reference.
+ *
+ * The paper counts a new link only after the CAS that published it.  In the meantime another thread can remove the
+ * link again and drop a reference that has never been counted, which frees the node under the feet of its owner;
+ * therefore the link is counted before the CAS and the count is dropped again when the CAS fails.
+ */
+static inline void
+LINK_NODE(list_t *list, node_t *node) {
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPLinkNode(node);
+		return;
+	}
+	if (list->reclaim == LL_RECLAIM_REFCOUNT) {
+		(void)COPY_NODE(list, node);
+	}
+}
+
+static inline void
+UNLINK_NODE(list_t *list, node_t *node) {
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPUnlinkNode(list, node);
+		return;
+	}
+	if (list->reclaim == LL_RECLAIM_REFCOUNT) {
+		RELEASE_NODE(list, node);
+	}
+}
+
+static inline void
+ADOPT_NODE(list_t *list, node_t *node) {
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPLinkNode(node);
+	}
+}
+
+static inline void
+ADOPTED_NODE(list_t *list, node_t *node) {
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPReleaseNode(list, node);
+	}
+}
+
+static inline void
+UNADOPT_NODE(list_t *list, node_t *node) {
+	if (list->reclaim == LL_RECLAIM_HP) {
+		HPUnlinkNode(list, node);
+	}
+}
 
 /*
  * C1  node:=MALLOC_NODE();
  * C2  node.value:=value;
  * C3  return node;
  */
-node_t *
-CreateNode(void *value) {
-	node_t *node = MALLOC_NODE(); /* C1 */
+static node_t *
+CreateNode(list_t *list, void *value) {
+	node_t *node = MALLOC_NODE(list); /* C1 */
 	node->value = value; /* C2 */
 	return node; /* C3 */
 }
@@ -241,11 +533,31 @@ CreateNode(void *value) {
 /*
  * RR1 RELEASE_NODE(node.prev.p);
  * RR2 RELEASE_NODE(node.next.p);
+ *
+ * The links of a discarded node are NULL, see DiscardNode.
  */
-void
-ReleaseReferences(node_t *node) {
-	RELEASE_NODE((node_t *)get_unmarked(atomic_load(&node->prev))); /* RR1 */
-	RELEASE_NODE((node_t *)get_unmarked(atomic_load(&node->next))); /* RR2 */
+static void
+ReleaseReferences(list_t *list, node_t *node) {
+	node_t *prev = (node_t *)get_unmarked(atomic_load(&node->prev));
+	node_t *next = (node_t *)get_unmarked(atomic_load(&node->next));
+	if (prev != NULL) {
+		RELEASE_NODE(list, prev); /* RR1 */
+	}
+	if (next != NULL) {
+		RELEASE_NODE(list, next); /* RR2 */
+	}
+}
+
+/*
+ * Give up a node that has never been published.  Its links were filled in without counting them, clear them so that
+ * the last release does not drop references it never held.
+ */
+static void
+DiscardNode(list_t *list, node_t *node) {
+	atomic_store(&node->prev, 0);
+	atomic_store(&node->next, 0);
+	RemovedNodes(list, 1);
+	RELEASE_NODE(list, node);
 }
 
 #define FAA(address, number) atomic_fetch_add_acquire(address, number)
@@ -284,24 +596,35 @@ _RemoveCrossReference(list_t *list, node_t *node, char *file, unsigned int line)
  * PL14   Back-Off
  * PL15 PushCommon(node,next);
  */
-void
+static void
 PushLeft(list_t *list, void *value) {
-	node_t *node = CreateNode(value); /* PL1 */
-	node_t *prev = COPY_NODE(list->head); /* PL2 */
-	node_t *next = READ_NODE(&prev->next); /* PL3 */
+	node_t *node = CreateNode(list, value); /* PL1 */
+	node_t *prev = COPY_NODE(list, &list->head); /* PL2 */
+	node_t *next = READ_NODE(list, &prev->next); /* PL3 */
+	unsigned int backoff = 0;
 	for (;;) { /* PL4 */
 		if (atomic_load(&prev->next) != get_unmarked(next)) { /* PL5 */
-			RELEASE_NODE(next); /* PL6 */
-			next = READ_NODE(&prev->next); /* PL7 */
+			RELEASE_NODE(list, next); /* PL6 */
+			next = READ_NODE(list, &prev->next); /* PL7 */
 			continue; /* PL8 */
 		}
 		atomic_init(&node->prev, get_unmarked(prev)); /* PL9 */
 		atomic_init(&node->next, get_unmarked(next)); /* PL10 */
+		LINK_NODE(list, node); /* PL12 */
+		ADOPT_NODE(list, prev); /* node.prev */
 		if (CAS(&prev->next, get_unmarked(next), get_unmarked(node))) { /* PL11 */
-			COPY_NODE(node); /* PL12 */
+			ADOPTED_NODE(list, prev);
 			break; /* PL13 */
 		}
-		sched_yield(); /* PL14 */
+		UNADOPT_NODE(list, prev);
+		UNLINK_NODE(list, node);
+		if (list->elim_left != NULL && ll_elim_push(list->elim_left, value)) {
+			RELEASE_NODE(list, next);
+			RELEASE_NODE(list, prev);
+			DiscardNode(list, node);
+			return;
+		}
+		ll_cm_backoff(list->cm, &backoff); /* PL14 */
 	}
 	PushCommon(list, node, next); /* PL15 */
 }
@@ -322,11 +645,12 @@ PushLeft(list_t *list, void *value) {
  * PR13   Back-Off
  * PR14 PushCommon(node,next);
  */
-void
+static void
 PushRight(list_t *list, void *value) {
-	node_t *node = CreateNode(value); /* PR1 */
-	node_t *next = COPY_NODE(list->tail); /* PR2 */
-	node_t *prev = READ_NODE(&next->prev); /* PR3 */
+	node_t *node = CreateNode(list, value); /* PR1 */
+	node_t *next = COPY_NODE(list, &list->tail); /* PR2 */
+	node_t *prev = READ_NODE(list, &next->prev); /* PR3 */
+	unsigned int backoff = 0;
 	for (;;) { /* PR4 */
 		if (atomic_load(&prev->next) != get_unmarked(next)) { /* PR5 */
 			prev = HelpInsert(list, prev, next); /* PR6 */
@@ -334,11 +658,21 @@ PushRight(list_t *list, void *value) {
 		}
 		atomic_init(&node->prev, get_unmarked(prev)); /* PR8 */
 		atomic_init(&node->next, get_unmarked(next)); /* PR9 */
+		LINK_NODE(list, node); /* PR11 */
+		ADOPT_NODE(list, prev); /* node.prev */
 		if (CAS(&prev->next, get_unmarked(next), get_unmarked(node))) { /* PR10 */
-			COPY_NODE(node); /* PR11 */
+			ADOPTED_NODE(list, prev);
 			break; /* PR12 */
 		}
-		sched_yield(); /* PR13 */
+		UNADOPT_NODE(list, prev);
+		UNLINK_NODE(list, node);
+		if (list->elim_right != NULL && ll_elim_push(list->elim_right, value)) {
+			RELEASE_NODE(list, prev);
+			RELEASE_NODE(list, next);
+			DiscardNode(list, node);
+			return;
+		}
+		ll_cm_backoff(list->cm, &backoff); /* PR13 */
 	}
 	PushCommon(list, node, next); /* PR14 */
 }
@@ -364,25 +698,27 @@ void
 _PushCommon(list_t *list, node_t *node, node_t *next, char *file, unsigned int line) {
 	pnode("PushCommon:node", node, file, line);
 	pnode("PushCommon:next", next, file, line);
+	unsigned int backoff = 0;
 	for (;;) { /* PC1 */
 		link_t link1 = atomic_load(&next->prev); /* PC2 */
 		if (is_marked(link1) || atomic_load(&node->next) != get_unmarked(next)) { /* PC3 */
 			break; /* PC4 */
 		}
+		LINK_NODE(list, node); /* PC6 */
 		if (CAS(&next->prev, link1, get_unmarked(node))) { /* PC5 */
-			COPY_NODE(node); /* PC6 */
-			RELEASE_NODE((node_t *)get_unmarked(link1)); /* PC7 */
+			UNLINK_NODE(list, (node_t *)get_unmarked(link1)); /* PC7 */
 			if (is_marked(atomic_load(&node->prev))) { /* PC8 */
-				node_t *prev2 = COPY_NODE(node); /* PC9 */
+				node_t *prev2 = COPY_NODE(list, node); /* PC9 */
 				prev2 = HelpInsert(list, prev2, next); /* PC10 */
-				RELEASE_NODE(prev2); /* PC11 */
+				RELEASE_NODE(list, prev2); /* PC11 */
 			}
 			break; /* PC12 */
 		}
-		sched_yield(); /* PC13 */
+		UNLINK_NODE(list, node);
+		ll_cm_backoff(list->cm, &backoff); /* PC13 */
 	}
-	RELEASE_NODE(next); /* PC14 */
-	RELEASE_NODE(node); /* PC15 */
+	RELEASE_NODE(list, next); /* PC14 */
+	RELEASE_NODE(list, node); /* PC15 */
 }
 
 /*
@@ -412,38 +748,71 @@ _PushCommon(list_t *list, node_t *node, node_t *next, char *file, unsigned int l
  * PL24 RELEASE_NODE(node);
  * PL25 return value;
  */
-void *
+static void *
 PopLeft(list_t *list) {
 	node_t *node = NULL;
 	void *value = NULL;
-	node_t *prev = COPY_NODE(list->head); /* PL1 */
+	node_t *prev = COPY_NODE(list, &list->head); /* PL1 */
+	unsigned int backoff = 0;
 	for (;;) { /* PL2 */
-		node = READ_NODE(&prev->next); /* PL3 */
-		if (node == list->tail) { /* PL4 */
-			RELEASE_NODE(node); /* PL5 */
-			RELEASE_NODE(prev); /* PL6 */
+		node = READ_NODE(list, &prev->next); /* PL3 */
+		if (node == &list->tail) { /* PL4 */
+			RELEASE_NODE(list, node); /* PL5 */
+			RELEASE_NODE(list, prev); /* PL6 */
 			return NULL; /* PL7 */
 		}
 		link_t link1 = atomic_load(&node->next); /* PL8 */
 		if (is_marked(link1)) { /* PL9 */
 			HelpDelete(list, node); /* PL10 */
-			RELEASE_NODE(node); /* PL11 */
+			RELEASE_NODE(list, node); /* PL11 */
 			continue; /* PL12 */
 		}
 		if (CAS(&node->next, link1, get_marked(link1))) { /* PL13 */
 			HelpDelete(list, node); /* PL14 */
-			node_t *next = READ_DEL_NODE(&node->next); /* PL15 */
+			node_t *next = READ_DEL_NODE(list, &node->next); /* PL15 */
 			prev = HelpInsert(list, prev, next); /* PL16 */
-			RELEASE_NODE(prev); /* PL17 */
-			RELEASE_NODE(next); /* PL18 */
+			RELEASE_NODE(list, prev); /* PL17 */
+			RELEASE_NODE(list, next); /* PL18 */
 			value = node->value; /* PL19 */
 			break; /* PL20 */
 		}
-		RELEASE_NODE(node); /* PL21 */
-		sched_yield(); /* PL22 */
+		RELEASE_NODE(list, node); /* PL21 */
+		if (list->elim_left != NULL && (value = ll_elim_pop(list->elim_left)) != NULL) {
+			RELEASE_NODE(list, prev);
+			return value;
+		}
+		ll_cm_backoff(list->cm, &backoff); /* PL22 */
 	}
+	RemovedNodes(list, 1);
 	RemoveCrossReference(list, node); /* PL23 */
-	RELEASE_NODE(node); /* PL24 */
+	RELEASE_NODE(list, node); /* PL24 */
+	return value;
+}
+
+/*
+ * PL1-PL12 of PopLeft() without the claim: the value of the first node that is not being deleted, left in the deque.
+ */
+static void *
+PeekLeft(list_t *list) {
+	void *value = NULL;
+	node_t *prev = COPY_NODE(list, &list->head);
+	for (;;) {
+		node_t *node = READ_NODE(list, &prev->next);
+		if (node == &list->tail) {
+			RELEASE_NODE(list, node);
+			break;
+		}
+		link_t link1 = atomic_load(&node->next);
+		if (is_marked(link1)) {
+			HelpDelete(list, node);
+			RELEASE_NODE(list, node);
+			continue;
+		}
+		value = node->value;
+		RELEASE_NODE(list, node);
+		break;
+	}
+	RELEASE_NODE(list, prev);
 	return value;
 }
 
@@ -471,38 +840,45 @@ PopLeft(list_t *list) {
  * PR22 return value;
  */
 
-void *
+static void *
 PopRight(list_t *list) {
 	void *value = NULL;
 
-	node_t *next = COPY_NODE(list->tail); /* PR1 */
-	node_t *node = READ_NODE(&next->prev); /* PR2 */
+	node_t *next = COPY_NODE(list, &list->tail); /* PR1 */
+	node_t *node = READ_NODE(list, &next->prev); /* PR2 */
 
 	pnode("PopRight:node", node, __FILE__, __LINE__);
 
+	unsigned int backoff = 0;
 	for (;;) { /* PR3 */
 		if (atomic_load(&node->next) != get_unmarked(next)) { /* PR4 */
 			node = HelpInsert(list, node, next); /* PR5 */
 			continue; /* PR6 */
 		}
-		if (node == list->head) { /* PR7 */
-			RELEASE_NODE(node); /* PR8 */
-			RELEASE_NODE(next); /* PR9 */
+		if (node == &list->head) { /* PR7 */
+			RELEASE_NODE(list, node); /* PR8 */
+			RELEASE_NODE(list, next); /* PR9 */
 			return NULL; /* PR10 */
 		}
 		if (CAS(&node->next, get_unmarked(next), get_marked(next))) { /* PR11 */
 			HelpDelete(list, node); /* PR12 */
-			node_t *prev = READ_DEL_NODE(&node->prev); /* PR13 */
+			node_t *prev = READ_DEL_NODE(list, &node->prev); /* PR13 */
 			prev = HelpInsert(list, prev, next); /* PR14 */
-			RELEASE_NODE(prev); /* PR15 */
-			RELEASE_NODE(next); /* PR16 */
+			RELEASE_NODE(list, prev); /* PR15 */
+			RELEASE_NODE(list, next); /* PR16 */
 			value = node->value; /* PR17 */
 			break; /* PR18 */
 		}
-		sched_yield(); /* PR19 */
+		if (list->elim_right != NULL && (value = ll_elim_pop(list->elim_right)) != NULL) {
+			RELEASE_NODE(list, node);
+			RELEASE_NODE(list, next);
+			return value;
+		}
+		ll_cm_backoff(list->cm, &backoff); /* PR19 */
 	}
+	RemovedNodes(list, 1);
 	RemoveCrossReference(list, node); /* PR20 */
-	RELEASE_NODE(node); /* PR21 */
+	RELEASE_NODE(list, node); /* PR21 */
 	return value; /* PR22 */
 }
 
@@ -555,46 +931,48 @@ _HelpDelete(list_t *list, node_t *node, char *file, unsigned int line) {
 		}
 	}
 	bool lastlink = true; /* HD5 */
-	node_t *prev = READ_DEL_NODE(&node->prev); /* HD6 */
-	node_t *next = READ_DEL_NODE(&node->next); /* HD7 */
+	node_t *prev = READ_DEL_NODE(list, &node->prev); /* HD6 */
+	node_t *next = READ_DEL_NODE(list, &node->next); /* HD7 */
 
+	unsigned int backoff = 0;
 	for (;;) { /* HD8 */
 		if (prev == next) { /* HD9 */
 			break; /* HD9 */
 		}
 		if (is_marked(atomic_load(&next->next))) { /* HD10 */
-			node_t *next2 = READ_DEL_NODE(&next->next); /* HD11 */
-			RELEASE_NODE(next); /* HD12 */
+			node_t *next2 = READ_DEL_NODE(list, &next->next); /* HD11 */
+			RELEASE_NODE(list, next); /* HD12 */
 			next = next2; /* HD13 */
 			continue; /* HD14 */
 		}
-		node_t *prev2 = READ_NODE(&prev->next); /* HD15 */
+		node_t *prev2 = READ_NODE(list, &prev->next); /* HD15 */
 		if (prev2 == NULL) { /* HD16 */
 			if (lastlink == false) { /* HD17 */
 				HelpDelete(list, prev); /* HD18 */
 				lastlink = true; /* HD19 */
 			}
-			prev2 = READ_DEL_NODE(&prev->prev); /* HD20 */
-			RELEASE_NODE(prev); /* HD21 */
+			prev2 = READ_DEL_NODE(list, &prev->prev); /* HD20 */
+			RELEASE_NODE(list, prev); /* HD21 */
 			prev = prev2; /* HD22 */
 			continue; /* HD23 */
 		}
 		if (prev2 != node) { /* HD24 */
 			lastlink = false; /* HD25 */
-			RELEASE_NODE(prev); /* HD26 */
+			RELEASE_NODE(list, prev); /* HD26 */
 			prev = prev2; /* HD27 */
 			continue; /* HD28 */
 		}
-		RELEASE_NODE(prev2); /* HD29 */
+		RELEASE_NODE(list, prev2); /* HD29 */
+		LINK_NODE(list, next); /* HD31 */
 		if (CAS(&prev->next, get_unmarked(node), get_unmarked(next))) { /* HD30 */
-			COPY_NODE(next); /* HD31 */
-			RELEASE_NODE(node); /* HD32 */
+			UNLINK_NODE(list, node); /* HD32 */
 			break; /* HD33 */
 		}
-		sched_yield(); /* HD34 */
+		UNLINK_NODE(list, next);
+		ll_cm_backoff(list->cm, &backoff); /* HD34 */
 	}
-	RELEASE_NODE(prev); /* HD35 */
-	RELEASE_NODE(next); /* HD36 */
+	RELEASE_NODE(list, prev); /* HD35 */
+	RELEASE_NODE(list, next); /* HD36 */
 }
 
 /*
@@ -633,42 +1011,45 @@ _HelpInsert(list_t *list, node_t *prev, node_t *node, char *file, unsigned int l
 	pnode("HelpInsert:prev", prev, file, line);
 	pnode("HelpInsert:node", node, file, line);
 	bool lastlink = true; /* HI1 */
+	unsigned int backoff = 0;
 	for (;;) { /* HI2 */
-		node_t *prev2 = READ_NODE(&prev->next); /* HI3 */
+		node_t *prev2 = READ_NODE(list, &prev->next); /* HI3 */
 		if (prev2 == NULL) { /* HI4 */
 			if (lastlink == false) { /* HI5 */
 				HelpDelete(list, prev); /* HI6 */
 				lastlink = true; /* HI7 */
 			}
-			prev2 = READ_DEL_NODE(&prev->prev); /* HI8 */
-			RELEASE_NODE(prev); /* HI9 */
+			prev2 = READ_DEL_NODE(list, &prev->prev); /* HI8 */
+			RELEASE_NODE(list, prev); /* HI9 */
 			prev = prev2; /* HI10 */
 			continue; /* HI11 */
 		}
-		/* link_t link1 = atomic_load(&node->prev); /\* HI12 *\/ */
-		node_t *link1 = READ_DEL_NODE(&node->prev); /* HI12 fixed */
+		/*
+		 * The link keeps its target alive as long as it points to it, the reference is dropped only after the
+		 * CAS below replaced it.  Reading it with READ_DEL_NODE() would lose the deletion mark.
+		 */
+		link_t link1 = atomic_load(&node->prev); /* HI12 */
 		if (is_marked(link1)) { /* HI13 */
-			RELEASE_NODE((node_t *)get_unmarked(link1)); /* HI24 */
-			RELEASE_NODE(prev2); /* HI14 */
+			RELEASE_NODE(list, prev2); /* HI14 */
 			break; /* HI15 */
 		}
 		if (prev2 != node) { /* HI16 */
 			lastlink = false; /* HI17 */
-			RELEASE_NODE((node_t *)get_unmarked(link1)); /* HI24 */
-			RELEASE_NODE(prev); /* HI18 */
+			RELEASE_NODE(list, prev); /* HI18 */
 			prev = prev2; /* HI19 */
 			continue; /* HI20 */
 		}
-		RELEASE_NODE(prev2); /* HI21 */
+		RELEASE_NODE(list, prev2); /* HI21 */
+		LINK_NODE(list, prev); /* HI23 */
 		if (CAS(&node->prev, link1, get_unmarked(prev))) { /* HI22 */
-			COPY_NODE(prev); /* HI23 */
-			RELEASE_NODE((node_t *)get_unmarked(link1)); /* HI24 */
+			UNLINK_NODE(list, (node_t *)get_unmarked(link1)); /* HI24 */
 			if (is_marked(atomic_load(&prev->prev))) { /* HI25 */
 				continue; /* HI25 */
 			}
 			break; /* HI26 */
 		}
-		sched_yield(); /* HI27 */
+		UNLINK_NODE(list, prev);
+		ll_cm_backoff(list->cm, &backoff); /* HI27 */
 	}
 	return prev; /* HI28 */
 }
@@ -690,187 +1071,481 @@ _HelpInsert(list_t *list, node_t *prev, node_t *node, char *file, unsigned int l
  * RC14   break;
  */
 static void
-_RemoveCrossReference(list_t *list __attribute__((unused)), node_t *node, char *file, unsigned int line) {
+_RemoveCrossReference(list_t *list, node_t *node, char *file, unsigned int line) {
 	pnode("RemoveCrossReference:node", node, file, line);
 	for (;;) { /* RC1 */
 		node_t *prev = (node_t *)get_unmarked(atomic_load(&node->prev)); /* RC2 */
 		if (is_marked(atomic_load(&prev->next))) { /* RC3 */
-			node_t *prev2 = READ_DEL_NODE(&prev->prev); /* RC4 */
+			node_t *prev2 = READ_DEL_NODE(list, &prev->prev); /* RC4 */
+			ADOPT_NODE(list, prev2);
 			atomic_store(&node->prev, get_marked(prev2)); /* RC5 */
-			RELEASE_NODE(prev); /* RC6 */
+			ADOPTED_NODE(list, prev2);
+			UNLINK_NODE(list, prev); /* RC6 */
 			continue; /* RC7 */
 		}
 		node_t *next = (node_t *)get_unmarked(atomic_load(&node->next)); /* RC8 */
 		if (is_marked(atomic_load(&next->next))) { /* RC9 */
-			node_t *next2 = READ_DEL_NODE(&next->next); /* RC10 */
+			node_t *next2 = READ_DEL_NODE(list, &next->next); /* RC10 */
+			ADOPT_NODE(list, next2);
 			atomic_store(&node->next, get_marked(next2)); /* RC11 */
-			RELEASE_NODE(next); /* RC12 */
+			ADOPTED_NODE(list, next2);
+			UNLINK_NODE(list, next); /* RC12 */
 			continue; /* RC13 */
 		}
 		break; /* RC14 */
 	}
 }
 
-#define MAGIC (void *)0xdeadbeee
+/*
+ * Create the nodes for 'values' and link them to each other privately, left to right, or right to left if 'reverse'
+ * is set.  Nobody else can see the chain yet, so plain stores will do; every link is counted as usual.  The caller
+ * keeps the local references to the first and the last node only, the nodes in between are held by their links.
+ */
+static void
+CreateChain(list_t *list, void **values, size_t n, bool reverse, node_t **firstp, node_t **lastp) {
+	node_t *first = CreateNode(list, values[reverse ? n - 1 : 0]);
+	node_t *last = first;
+
+	for (size_t i = 1; i < n; i++) {
+		node_t *node = CreateNode(list, values[reverse ? n - 1 - i : i]);
+		LINK_NODE(list, last);
+		atomic_init(&node->prev, get_unmarked(last));
+		LINK_NODE(list, node);
+		atomic_store(&last->next, get_unmarked(node));
+		if (last != first) {
+			RELEASE_NODE(list, last);
+		}
+		last = node;
+	}
 
-static atomic_uint_fast32_t deletes = 0;
-static atomic_uint_fast32_t inserts = 0;
+	*firstp = first;
+	*lastp = last;
+}
 
-static bool
-_CheckConsistency(list_t *list) {
-	size_t i = 0;
-	node_t *node = list->head;
-	/* assert((node_t *)list->head->prev == NULL); */
-	/* assert((node_t *)list->tail->next == NULL); */
+/*
+ * Same as PushLeft and PushRight, except that the whole chain is spliced in with the CAS on prev.next and next.prev is
+ * fixed up once for the last node of the chain.  The values end up in the same order as if they had been pushed one by
+ * one.
+ */
+static void
+PushChain(list_t *list, node_t *first, node_t *last, node_t *prev, node_t *next, bool left) {
+	unsigned int backoff = 0;
+	for (;;) {
+		if (atomic_load(&prev->next) != get_unmarked(next)) {
+			if (left) {
+				RELEASE_NODE(list, next);
+				next = READ_NODE(list, &prev->next);
+			} else {
+				prev = HelpInsert(list, prev, next);
+			}
+			continue;
+		}
+		atomic_store(&first->prev, get_unmarked(prev));
+		atomic_store(&last->next, get_unmarked(next));
+		LINK_NODE(list, first);
+		ADOPT_NODE(list, prev); /* first.prev */
+		if (CAS(&prev->next, get_unmarked(next), get_unmarked(first))) {
+			ADOPTED_NODE(list, prev);
+			break;
+		}
+		UNADOPT_NODE(list, prev);
+		UNLINK_NODE(list, first);
+		ll_cm_backoff(list->cm, &backoff);
+	}
+	PushCommon(list, last, next);
+	if (first != last) {
+		RELEASE_NODE(list, first);
+	}
+}
+
+static void
+PushLeftBatch(list_t *list, void **values, size_t n) {
+	node_t *first, *last;
 
-	while (node != list->tail) {
-		__attribute__((unused)) node_t *prev = (node_t *)get_unmarked(node);
-		node = (node_t *)get_unmarked(node->next);
+	if (n == 0) {
+		return;
+	}
+
+	CreateChain(list, values, n, true, &first, &last);
+	node_t *prev = COPY_NODE(list, &list->head);
+	node_t *next = READ_NODE(list, &prev->next);
+	PushChain(list, first, last, prev, next, true);
+}
 
-		/* if ((node_t *)get_unmarked(node->prev) != prev) { */
-		/* 	return false; */
-		/* } */
-		if (i > (atomic_load(&inserts) + 1 + NTHREADS - atomic_load(&deletes))) {
-/*			fprintf(stderr, "%zu %zu %zu %zu\n", i, atomic_load(&inserts), atomic_load(&deletes), inserts + 1 - deletes); */
+static void
+PushRightBatch(list_t *list, void **values, size_t n) {
+	node_t *first, *last;
+
+	if (n == 0) {
+		return;
+	}
+
+	CreateChain(list, values, n, false, &first, &last);
+	node_t *next = COPY_NODE(list, &list->tail);
+	node_t *prev = READ_NODE(list, &next->prev);
+	PushChain(list, first, last, prev, next, false);
+}
+
+/*
+ * Pop up to 'n' values from the left.  The first node is taken exactly like in PopLeft, then the following nodes are
+ * marked one by one as long as nobody else has marked them first; every node still needs its own CAS, as it may be
+ * contended by PopRight.  All the marked nodes are unlinked together: HelpDelete on the first node skips over the
+ * marked successors and swings prev.next past the whole run with one CAS, and HelpInsert fixes the prev link of the
+ * node after the run once.
+ *
+ * Only the first and the last node of the run are held, the nodes in between are kept alive by the marked next links
+ * of their predecessors, which only RemoveCrossReference on the predecessor itself changes.  The walks over the run
+ * read the next node before they release the current one, so the run is not bounded by HP_MAX_LOCAL.
+ */
+static size_t
+PopLeftBatch(list_t *list, void **values, size_t n) {
+	node_t *first = NULL, *last = NULL, *node = NULL, *next = NULL;
+	size_t k = 0;
+	unsigned int backoff = 0;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	node_t *prev = COPY_NODE(list, &list->head);
+	for (;;) {
+		node = READ_NODE(list, &prev->next);
+		if (node == &list->tail) {
+			RELEASE_NODE(list, node);
+			RELEASE_NODE(list, prev);
+			return 0;
 		}
-		assert(i <= atomic_load(&inserts));
-		i++;
+		link_t link1 = atomic_load(&node->next);
+		if (is_marked(link1)) {
+			HelpDelete(list, node);
+			RELEASE_NODE(list, node);
+			continue;
+		}
+		if (CAS(&node->next, link1, get_marked(link1))) {
+			first = last = node;
+			k = 1;
+			break;
+		}
+		RELEASE_NODE(list, node);
+		ll_cm_backoff(list->cm, &backoff);
+	}
+
+	/* The next link of a marked node does not change anymore, follow it */
+	while (k < n) {
+		node = READ_DEL_NODE(list, &last->next);
+		if (node == &list->tail) {
+			RELEASE_NODE(list, node);
+			break;
+		}
+		link_t link1 = atomic_load(&node->next);
+		if (is_marked(link1) || !CAS(&node->next, link1, get_marked(link1))) {
+			RELEASE_NODE(list, node);
+			break;
+		}
+		if (last != first) {
+			RELEASE_NODE(list, last);
+		}
+		last = node;
+		k++;
 	}
-	node = list->tail;
-	i = 0;
-	while (node != list->head) {
-		__attribute__((unused)) node_t *next = (node_t *)get_unmarked(node);
-		node = (node_t *)get_unmarked(node->prev);
-		/* if ((node_t *)get_unmarked(node->next) != next) { */
-		/* 	return false; */
-		/* } */
-		if (i > (atomic_load(&inserts) + 1 + NTHREADS - atomic_load(&deletes))) {
-/*			fprintf(stderr, "%zu %zu %zu %zu\n", i, atomic_load(&inserts), atomic_load(&deletes), inserts + 1 - deletes); */
+
+	node = COPY_NODE(list, first);
+	for (size_t i = 0; i < k; i++) {
+		HelpDelete(list, node);
+		if (i + 1 < k) {
+			next = READ_DEL_NODE(list, &node->next);
+			RELEASE_NODE(list, node);
+			node = next;
 		}
-		assert(i <= atomic_load(&inserts));
-		i++;
 	}
-	return true;
+	RELEASE_NODE(list, node);
+	next = READ_DEL_NODE(list, &last->next);
+	prev = HelpInsert(list, prev, next);
+	RELEASE_NODE(list, prev);
+	RELEASE_NODE(list, next);
+	if (last != first) {
+		RELEASE_NODE(list, last);
+	}
+
+	RemovedNodes(list, k);
+	node = first;
+	for (size_t i = 0; i < k; i++) {
+		values[i] = node->value;
+		next = (i + 1 < k) ? READ_DEL_NODE(list, &node->next) : NULL;
+		RemoveCrossReference(list, node);
+		RELEASE_NODE(list, node);
+		node = next;
+	}
+
+	return k;
 }
 
-#define dir(x) (x)?"right":"left"
+#define WAIT_SPINS 128 /* Failed pops before going to sleep */
 
+static inline int64_t
+now_ns(void) {
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * Spin for a while first, the next value is often just around the corner, then sleep on the event count.  The pushes
+ * notify it after the value has been linked in, so the second pop after ll_ec_prepare() either sees the value or
+ * the wake-up is not missed.
+ */
 static void *
-insert_thread_right(void *arg) {
-	list_t *list = (list_t *)arg;
+PopWait(list_t *list, void *(*pop)(list_t *), long timeout_ns) {
+	int64_t deadline = (timeout_ns >= 0) ? now_ns() + timeout_ns : 0;
+	void *value = NULL;
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		(void)atomic_fetch_add(&inserts, 1);
-		PushRight(list, MAGIC);
+	for (unsigned int i = 0; i < WAIT_SPINS; i++) {
+		value = pop(list);
+		if (value != NULL) {
+			return value;
+		}
+		ll_cm_pause();
+	}
+
+	for (;;) {
+		unsigned int key = ll_ec_prepare(&list->ec);
+		value = pop(list);
+		if (value != NULL) {
+			ll_ec_cancel(&list->ec);
+			return value;
+		}
+		if (timeout_ns < 0) {
+			ll_ec_wait(&list->ec, key);
+		} else {
+			int64_t remaining = deadline - now_ns();
+			if (remaining <= 0) {
+				ll_ec_cancel(&list->ec);
+				return NULL;
+			}
+			(void)ll_ec_timedwait(&list->ec, key, (long)remaining);
+		}
+		value = pop(list);
+		if (value != NULL) {
+			return value;
+		}
 	}
-	return NULL;
 }
 
-static void *
-delete_thread_right(void *arg) {
-	list_t *list = (list_t *)arg;
+/*
+ * Flat combining front end, see fc.h.  The combiner runs the very same PushLeft, PopLeft, ... as the threads would on
+ * their own, so the operations that do not go through the combiner (the batches, or all of them while the combining
+ * is off) do not need to care about it.
+ */
+enum {
+	FC_PUSH_LEFT,
+	FC_PUSH_RIGHT,
+	FC_POP_LEFT,
+	FC_POP_RIGHT,
+};
+
+static uintptr_t
+DequeApply(void *ctx, unsigned int op, uintptr_t arg) {
+	list_t *list = (list_t *)ctx;
+
+	switch (op) {
+	case FC_PUSH_LEFT:
+		PushLeft(list, (void *)arg);
+		return 0;
+	case FC_PUSH_RIGHT:
+		PushRight(list, (void *)arg);
+		return 0;
+	case FC_POP_LEFT:
+		return (uintptr_t)PopLeft(list);
+	case FC_POP_RIGHT:
+		return (uintptr_t)PopRight(list);
+	default:
+		assert(0);
+		return 0;
+	}
+}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		void *value = PopRight(list);
-		if (value == NULL) {
-			return NULL;
-		}
-		(void)atomic_fetch_add(&deletes, 1);
-		assert(value == MAGIC);
+static void *
+DequeOp(list_t *list, unsigned int op, void *value) {
+	if (ll_fc_combining(list->fc)) {
+		return (void *)ll_fc_execute(list->fc, op, (uintptr_t)value);
 	}
-	return NULL;
+	return (void *)DequeApply(list, op, (uintptr_t)value);
 }
 
 static void *
-insert_thread_left(void *arg) {
-	list_t *list = (list_t *)arg;
+PopLeftOp(list_t *list) {
+	return DequeOp(list, FC_POP_LEFT, NULL);
+}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		(void)atomic_fetch_add(&inserts, 1);
-		PushLeft(list, MAGIC);
-	}
-	return NULL;
+static void *
+PopRightOp(list_t *list) {
+	return DequeOp(list, FC_POP_RIGHT, NULL);
 }
 
 static void *
-delete_thread_left(void *arg) {
-	list_t *list = (list_t *)arg;
+PopLeftWait(list_t *list, long timeout_ns) {
+	return PopWait(list, PopLeftOp, timeout_ns);
+}
 
-	for (size_t i = 0; i < NELEMENTS; i++) {
-		void *value = PopLeft(list);
-		if (value == NULL) {
-			return NULL;
-		}
-		(void)atomic_fetch_add(&deletes, 1);
-		assert(value == MAGIC);
-	}
-	return NULL;
+static void *
+PopRightWait(list_t *list, long timeout_ns) {
+	return PopWait(list, PopRightOp, timeout_ns);
 }
 
-int
-main(void) {
-	list_t *list = calloc(1, sizeof(*list));
-	list->head = &list->heads;
-	list->tail = &list->tails;
-	head = list->head;
-	tail = list->tail;
+/* PUBLIC */
+
+ll_deque_t *
+ll_deque_new(unsigned int flags) {
+	list_t *list = aligned_alloc(alignof(list_t), sizeof(*list));
+	assert(list != NULL);
+
+	*list = (list_t){
+		.cm = ll_cm_new(LL_CM_BACKOFF, 0, 0),
+		.pool = ((flags & LL_DEQUE_ARENA) != 0)
+				? ll_pool_new_arena(sizeof(node_t), alignof(node_t), offsetof(node_t, value))
+				: ll_pool_new(sizeof(node_t), alignof(node_t), offsetof(node_t, value), 0),
+		.reclaim = LL_RECLAIM_REFCOUNT,
+	};
+	ll_ec_init(&list->ec);
+	if ((flags & LL_DEQUE_ELIMINATION) != 0) {
+		list->elim_left = ll_elim_new();
+		list->elim_right = ll_elim_new();
+	}
+	list->fc = ll_fc_new(DequeApply, list, list->cm, ((flags & LL_DEQUE_COMBINING) != 0) ? LL_FC_ADAPTIVE : LL_FC_OFF);
+	list->head.list = list;
+	list->tail.list = list;
+	if ((flags & LL_DEQUE_LEAK) != 0) {
+		list->reclaim = LL_RECLAIM_NONE;
+	} else if ((flags & LL_DEQUE_HP) != 0) {
+		list->reclaim = LL_RECLAIM_HP;
+		list->hp = ll_hp_new(HP_MAX_LOCAL, HPDeleteNode);
+	}
+
+	node_t *head = &list->head;
+	node_t *tail = &list->tail;
+
+	LINK_NODE(list, head);
+	atomic_init(&tail->prev, (uintptr_t)head);
+	LINK_NODE(list, tail);
+	atomic_init(&head->next, (uintptr_t)tail);
+
+	LINK_NODE(list, tail);
+	atomic_init(&tail->next, (uintptr_t)tail);
+	LINK_NODE(list, head);
+	atomic_init(&head->prev, (uintptr_t)head);
 
-	atomic_init(&tail->prev, (uintptr_t)COPY_NODE(head));
-	atomic_init(&head->next, (uintptr_t)COPY_NODE(tail));
+	return (list);
+}
 
-	atomic_init(&tail->next, (uintptr_t)COPY_NODE(tail));
-	atomic_init(&head->prev, (uintptr_t)COPY_NODE(head));
+void
+ll_deque_destroy(ll_deque_t *list) {
+	assert(list != NULL);
 
-	fprintf(stderr, "IR\n");
+	if (list->reclaim == LL_RECLAIM_HP) {
+		list->destroying = true;
+		ll_hp_destroy(list->hp);
+	}
+	/* The nodes still in the deque live in the pool slabs */
+	ll_pool_destroy(list->pool);
+	ll_fc_destroy(list->fc);
+	ll_cm_destroy(list->cm);
+	if (list->elim_left != NULL) {
+		ll_elim_destroy(list->elim_left);
+		ll_elim_destroy(list->elim_right);
+	}
+	free(list);
+}
 
-	insert_thread_right(list);
+void
+ll_deque_push_left(ll_deque_t *list, void *value) {
+	assert(value != NULL);
+	(void)DequeOp(list, FC_PUSH_LEFT, value);
+	ll_ec_notify(&list->ec, 1);
+}
 
-	assert(CheckConsistency(list));
-	fprintf(stderr, "IL\n");
+void
+ll_deque_push_right(ll_deque_t *list, void *value) {
+	assert(value != NULL);
+	(void)DequeOp(list, FC_PUSH_RIGHT, value);
+	ll_ec_notify(&list->ec, 1);
+}
 
-	insert_thread_left(list);
+void *
+ll_deque_pop_left(ll_deque_t *list) {
+	return (PopLeftOp(list));
+}
 
-	size_t nthreads = NTHREADS;
-	if (nthreads > 0) {
-		pthread_t threads[nthreads];
+void *
+ll_deque_pop_right(ll_deque_t *list) {
+	return (PopRightOp(list));
+}
 
-		assert(nthreads / 4 >= 1);
-		assert(nthreads % 4 == 0);
+void *
+ll_deque_peek_left(ll_deque_t *list) {
+	return (PeekLeft(list));
+}
 
-		for (size_t i = 0; i < nthreads; i++) {
-			switch (i % 4) {
-			case 0: pthread_create(&threads[i], NULL, insert_thread_right, list); break;
-			case 1: pthread_create(&threads[i], NULL, delete_thread_left, list); break;
-			case 2: pthread_create(&threads[i], NULL, insert_thread_left, list); break;
-			case 3: pthread_create(&threads[i], NULL, delete_thread_right, list); break;
-			default: assert(0);
-			}
-		}
+void
+ll_deque_push_left_batch(ll_deque_t *list, void **values, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		assert(values[i] != NULL);
+	}
+	PushLeftBatch(list, values, n);
+	ll_ec_notify(&list->ec, (n < INT_MAX) ? (int)n : INT_MAX);
+}
 
-		for (size_t i = 0; i < nthreads; i++) {
-			pthread_join(threads[i], NULL);
-		}
+void
+ll_deque_push_right_batch(ll_deque_t *list, void **values, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		assert(values[i] != NULL);
 	}
+	PushRightBatch(list, values, n);
+	ll_ec_notify(&list->ec, (n < INT_MAX) ? (int)n : INT_MAX);
+}
+
+size_t
+ll_deque_pop_left_batch(ll_deque_t *list, void **values, size_t n) {
+	return (PopLeftBatch(list, values, n));
+}
 
-	assert(CheckConsistency(list));
-	fprintf(stderr, "DR\n");
+void *
+ll_deque_pop_left_wait(ll_deque_t *list, long timeout_ns) {
+	return (PopLeftWait(list, timeout_ns));
+}
 
-	delete_thread_right(list);
+void *
+ll_deque_pop_right_wait(ll_deque_t *list, long timeout_ns) {
+	return (PopRightWait(list, timeout_ns));
+}
 
-	assert(CheckConsistency(list));
-	fprintf(stderr, "DL\n");
+ll_cm_t *
+ll_deque_cm(ll_deque_t *list) {
+	return (list->cm);
+}
 
-	delete_thread_left(list);
+size_t
+ll_deque_unreclaimed(ll_deque_t *list) {
+	uint_fast64_t removed = 0, reclaimed = 0;
 
-	fprintf(stderr, "Checking consistency...");
-	assert(CheckConsistency(list));
-	fprintf(stderr, "done.\n");
+	for (size_t i = 0; i < LL_TID_MAX; i++) {
+		reclaimed += atomic_load_explicit(&list->counters[i].reclaimed, memory_order_relaxed);
+		removed += atomic_load_explicit(&list->counters[i].removed, memory_order_relaxed);
+	}
 
-	while (PopLeft(list) != NULL) {}
+	/* The counters are read one after another, a node can be seen reclaimed before it is seen removed */
+	return ((removed > reclaimed) ? (size_t)(removed - reclaimed) : 0);
+}
 
-	fprintf(stderr, "Checking consistency...");
-	assert(CheckConsistency(list));
-	fprintf(stderr, "done.\n");
+ll_fc_t *
+ll_deque_fc(ll_deque_t *list) {
+	return (list->fc);
+}
 
-	free(list);
+bool
+ll_deque_tracing(void) {
+#if defined(LL_DEQUE_TRACE)
+	return (true);
+#else
+	return (false);
+#endif
 }
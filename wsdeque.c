@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "hp.h"
+#include "wsdeque.h"
+
+#define WSDEQUE_DEFAULT_CAPACITY 256
+
+#define HP_ARRAY 0 /* The only hazard pointer, protects the array a thief reads from */
+
+typedef struct ws_array {
+	size_t mask;
+	atomic_uintptr_t slot[];
+} ws_array_t;
+
+/*
+ * 'top' is written by the thieves, 'bottom' and 'array' are written by
+ * the owner only; keep them on separate cache lines.
+ */
+struct ll_wsdeque {
+	alignas(128) atomic_int_fast64_t top;
+	alignas(128) atomic_int_fast64_t bottom;
+	atomic_uintptr_t array;
+	alignas(128) ll_hp_t *hp;
+};
+
+static ws_array_t *
+ws_array_new(size_t size) {
+	ws_array_t *a = malloc(sizeof(*a) + size * sizeof(a->slot[0]));
+	assert(a != NULL);
+
+	a->mask = size - 1;
+	for (size_t i = 0; i < size; i++) {
+		atomic_init(&a->slot[i], 0);
+	}
+
+	return (a);
+}
+
+static void
+ws_array_free(void *arg) {
+	free(arg);
+}
+
+#define ws_get(a, i)	atomic_load_explicit(&(a)->slot[(i) & (a)->mask], memory_order_relaxed)
+#define ws_put(a, i, v) atomic_store_explicit(&(a)->slot[(i) & (a)->mask], (v), memory_order_relaxed)
+
+ll_wsdeque_t *
+ll_wsdeque_new(size_t capacity) {
+	ll_wsdeque_t *deque = aligned_alloc(128, sizeof(*deque));
+	size_t size = 1;
+
+	assert(deque != NULL);
+
+	if (capacity == 0) {
+		capacity = WSDEQUE_DEFAULT_CAPACITY;
+	}
+	while (size < capacity) {
+		size <<= 1;
+	}
+
+	atomic_init(&deque->top, 0);
+	atomic_init(&deque->bottom, 0);
+	atomic_init(&deque->array, (uintptr_t)ws_array_new(size));
+	deque->hp = ll_hp_new(1, ws_array_free);
+
+	return (deque);
+}
+
+void
+ll_wsdeque_destroy(ll_wsdeque_t *deque) {
+	assert(deque != NULL);
+
+	ll_hp_destroy(deque->hp);
+	free((void *)atomic_load(&deque->array));
+	free(deque);
+}
+
+/*
+ * Double the array.  Only the owner calls this, and the thieves never
+ * write to the array, so a plain copy of the live range will do.  The
+ * release store publishes the copied slots together with the array.
+ */
+static ws_array_t *
+ws_grow(ll_wsdeque_t *deque, ws_array_t *a, int_fast64_t b, int_fast64_t t) {
+	ws_array_t *new = ws_array_new((a->mask + 1) * 2);
+
+	for (int_fast64_t i = t; i < b; i++) {
+		ws_put(new, i, ws_get(a, i));
+	}
+	atomic_store_explicit(&deque->array, (uintptr_t)new, memory_order_release);
+	ll_hp_retire(deque->hp, (uintptr_t)a);
+
+	return (new);
+}
+
+void
+ll_wsdeque_push(ll_wsdeque_t *deque, void *value) {
+	int_fast64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	int_fast64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+	ws_array_t *a = (ws_array_t *)atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+	assert(value != NULL);
+
+	if (b - t > (int_fast64_t)a->mask) {
+		a = ws_grow(deque, a, b, t);
+	}
+	ws_put(a, b, (uintptr_t)value);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+void *
+ll_wsdeque_pop(ll_wsdeque_t *deque) {
+	int_fast64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	ws_array_t *a = (ws_array_t *)atomic_load_explicit(&deque->array, memory_order_relaxed);
+	void *value = NULL;
+
+	/* Claim the bottom slot before looking at top */
+	atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int_fast64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	if (t > b) {
+		/* Empty */
+		atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+		return (NULL);
+	}
+
+	value = (void *)ws_get(a, b);
+	if (t == b) {
+		/* The last value, race against the thieves for it */
+		if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+							     memory_order_relaxed)) {
+			value = NULL;
+		}
+		atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+	}
+
+	return (value);
+}
+
+void *
+ll_wsdeque_steal(ll_wsdeque_t *deque) {
+	int_fast64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int_fast64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	void *value = NULL;
+
+	if (t >= b) {
+		return (NULL);
+	}
+
+	ws_array_t *a = (ws_array_t *)ll_hp_protect(deque->hp, HP_ARRAY, &deque->array);
+	value = (void *)ws_get(a, t);
+	if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+						     memory_order_relaxed)) {
+		value = NULL;
+	}
+	ll_hp_clear_one(deque->hp, HP_ARRAY);
+
+	return (value);
+}
+
+size_t
+ll_wsdeque_size(ll_wsdeque_t *deque) {
+	int_fast64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	int_fast64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	return ((b > t) ? (size_t)(b - t) : 0);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*%
+ * Work-stealing deque.
+ *
+ * This is the dynamic circular work-stealing deque from David Chase and
+ * Yossi Lev, with the C11 memory orderings from Nhat Minh Lê, Antoniu
+ * Pop, Albert Cohen and Francesco Zappa Nardelli: Correct and Efficient
+ * Work-Stealing for Weak Memory Models.
+ *
+ * A single owner thread pushes and pops at the bottom end, any other
+ * thread can steal from the top end.  The owner's operations use plain
+ * loads and stores except when the deque is about to become empty;
+ * a steal is a single CAS.  The array grows when it is full, and the
+ * old arrays are reclaimed with hazard pointers, as a thief might still
+ * be reading from them.
+ *
+ * The values are opaque pointers owned by the caller; NULL is reserved
+ * to report an empty deque.
+ */
+
+typedef struct ll_wsdeque ll_wsdeque_t;
+
+ll_wsdeque_t *
+ll_wsdeque_new(size_t capacity);
+/*%<
+ * Create a new work-stealing deque with room for 'capacity' values
+ * before the first resize (or a reasonable default value if 'capacity'
+ * is 0).  The capacity is rounded up to a power of two.
+ */
+
+void
+ll_wsdeque_destroy(ll_wsdeque_t *deque);
+/*%<
+ * Destroy the deque.  No other thread may be using it.
+ */
+
+void
+ll_wsdeque_push(ll_wsdeque_t *deque, void *value);
+/*%<
+ * Push 'value' to the bottom of the deque.  Must be called from the
+ * owner thread only, 'value' must not be NULL.
+ *
+ * Progress condition: wait-free population oblivious, unless the array
+ * needs to grow, then bounded by the size of the deque.
+ */
+
+void *
+ll_wsdeque_pop(ll_wsdeque_t *deque);
+/*%<
+ * Pop the value from the bottom of the deque, or return NULL if the
+ * deque is empty.  Must be called from the owner thread only.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+void *
+ll_wsdeque_steal(ll_wsdeque_t *deque);
+/*%<
+ * Steal the value from the top of the deque.  Returns NULL if the deque
+ * is empty or if another thread took the value first; the caller is
+ * expected to try elsewhere rather than to spin on the same deque.
+ *
+ * Progress condition: wait-free population oblivious.
+ */
+
+size_t
+ll_wsdeque_size(ll_wsdeque_t *deque);
+/*%<
+ * Return the number of values in the deque.  The value is only a hint
+ * when other threads are using the deque.
+ */